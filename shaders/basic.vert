@@ -4,24 +4,60 @@ layout(location=0) in vec3 vPosition;
 layout(location=1) in vec3 vNormal;
 layout(location=2) in vec2 vTexCoords;
 
-out vec3 fPosition;
-out vec3 fNormal;
 out vec2 fTexCoords;
+// eye space position and normal, the lighting works in eye space
+out vec3 fPosEye;
+out vec3 fNormalEye;
 
-out vec4 fPosLightSpace;
+// world space position, the fragment shader picks the shadow cascade
+out vec3 fPosWorld;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// per-draw transforms (TransformBuffer.hpp), 7 texels each:
+// model matrix with the mesh dequantize folded in, then the normal matrix
+uniform samplerBuffer transforms;
+// first slot of this draw - per instance for pooled multi-draws, a constant attribute value
+// otherwise; the instances of a mesh use consecutive slots
+layout(location=3) in uint vTransform;
 
-uniform mat4 lightSpaceTrMatrix;
+mat4 fetchModel()
+{
+	int base = (int(vTransform) + gl_InstanceID) * 7;
+	return mat4(texelFetch(transforms, base), texelFetch(transforms, base + 1),
+		texelFetch(transforms, base + 2), texelFetch(transforms, base + 3));
+}
+
+mat3 fetchNormalMatrix()
+{
+	int base = (int(vTransform) + gl_InstanceID) * 7 + 4;
+	return mat3(texelFetch(transforms, base).xyz, texelFetch(transforms, base + 1).xyz,
+		texelFetch(transforms, base + 2).xyz);
+}
+
+#include "frameUniforms.glsl"
+
+// packed vertices carry octahedral normals in vNormal.xy
+// (their positions are quantized, the dequantize matrix is part of the model transform)
+uniform bool packedNormals;
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
 
 void main() 
 {
-	gl_Position = projection * view * model * vec4(vPosition, 1.0f);
-	fPosition = vPosition;
-	fNormal = vNormal;
+	mat4 model = fetchModel();
+	vec4 worldPosition = model * vec4(vPosition, 1.0f);
+	gl_Position = projection * view * worldPosition;
 	fTexCoords = vTexCoords;
+
+	vec3 normal = packedNormals ? octahedralDecode(vNormal.xy) : vNormal;
+	fPosEye = vec3(view * worldPosition);
+	fNormalEye = mat3(view) * (fetchNormalMatrix() * normal);
 	
-	fPosLightSpace = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	fPosWorld = vec3(worldPosition);
 }
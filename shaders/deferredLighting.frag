@@ -0,0 +1,47 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+// lighting pass of the deferred path, one full-screen quad over the G-buffer of gbuffer.frag
+uniform sampler2D gAlbedoSpecular;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+// rebuilt from the depth for each pixel, read by lighting.glsl
+vec3 fPosEye;
+vec3 fPosWorld;
+
+#include "lighting.glsl"
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0f);
+	n.x += n.x >= 0.0f ? -t : t;
+	n.y += n.y >= 0.0f ? -t : t;
+	return normalize(n);
+}
+
+void main() 
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+	float depth = texelFetch(gDepth, pixel, 0).r;
+	// nothing was drawn here, the skybox fills it
+	if (depth >= 1.0f)
+		discard;
+
+	// eye-space position from the depth and the perspective projection
+	vec3 ndc = vec3(gl_FragCoord.xy / vec2(textureSize(gDepth, 0)), depth) * 2.0f - 1.0f;
+	fPosEye.z = -projection[3][2] / (ndc.z + projection[2][2]);
+	fPosEye.xy = ndc.xy * -fPosEye.z / vec2(projection[0][0], projection[1][1]);
+	fPosWorld = transpose(mat3(view)) * (fPosEye - view[3].xyz);
+
+	vec4 albedoSpecular = texelFetch(gAlbedoSpecular, pixel, 0);
+	vec3 normalEye = octahedralDecode(texelFetch(gNormal, pixel, 0).xy * 2.0f - 1.0f);
+
+	fColor = vec4(shadeFragment(normalEye, albedoSpecular.rgb, vec3(albedoSpecular.a)), 1.0f);
+	// the skybox is drawn behind the scene afterwards
+	gl_FragDepth = depth;
+}
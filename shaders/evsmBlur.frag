@@ -0,0 +1,44 @@
+#version 410 core
+
+in vec2 fTexCoords;
+
+out vec4 fColor;
+
+// first pass: a shadow map cascade, converted to moments and blurred horizontally
+uniform sampler2DArray depthMap;
+uniform int cascade;
+// second pass: the moments of the first pass, blurred vertically
+uniform sampler2D blurSource;
+uniform int blurVertical;
+
+// exponents of the positive and negative warps, as in lighting.glsl
+const float EVSM_POSITIVE = 40.0f;
+const float EVSM_NEGATIVE = 5.0f;
+
+// 9 tap gaussian, one side
+const int BLUR_RADIUS = 4;
+const float weights[BLUR_RADIUS + 1] = float[](0.227027f, 0.194594f, 0.121621f, 0.054054f, 0.016216f);
+
+vec4 moments(float depth)
+{
+	depth = 2.0f * depth - 1.0f;
+	float positive = exp(EVSM_POSITIVE * depth);
+	float negative = -exp(-EVSM_NEGATIVE * depth);
+	return vec4(positive, positive * positive, negative, negative * negative);
+}
+
+void main() 
+{
+	vec4 sum = vec4(0.0f);
+	if (blurVertical == 0) {
+		float texel = 1.0f / float(textureSize(depthMap, 0).x);
+		for (int i = -BLUR_RADIUS; i <= BLUR_RADIUS; i++)
+			sum += weights[abs(i)] * moments(texture(depthMap, vec3(fTexCoords.x + float(i) * texel, fTexCoords.y, cascade)).r);
+	}
+	else {
+		float texel = 1.0f / float(textureSize(blurSource, 0).y);
+		for (int i = -BLUR_RADIUS; i <= BLUR_RADIUS; i++)
+			sum += weights[abs(i)] * texture(blurSource, vec2(fTexCoords.x, fTexCoords.y + float(i) * texel));
+	}
+	fColor = sum;
+}
@@ -0,0 +1,38 @@
+// Per-frame constants shared by every shader. The std140 layout is copied on the CPU
+// side in FrameUniforms.hpp, keep both in sync.
+
+// one light of the light loop (GpuLight in FrameUniforms.hpp)
+struct Light {
+	// eye space, w = 0 for a directional light whose xyz is the direction towards it
+	vec4 position;
+	// rgb, a = ambient strength
+	vec4 color;
+	// eye-space direction of a spot light, w = cosine of the outer cut-off (-1 without a cone)
+	vec4 spot;
+	// constant, linear and quadratic falloff, w = cosine of the inner cut-off
+	vec4 attenuation;
+	// x = LIGHT_SHADOW_* kind, y = first shadow atlas tile
+	ivec4 shadow;
+};
+
+// per-frame constants, filled once per frame (FrameUniforms.hpp)
+layout(std140) uniform FrameUniforms {
+	mat4 view;
+	mat4 projection;
+	// one per cascade (MAX_SHADOW_CASCADES)
+	mat4 lightSpaceTrMatrix[4];
+	// eye-space distance where each cascade ends
+	vec4 cascadeSplits;
+	int cascadeCount;
+	int shadowFilter;
+	int lightCount;
+	// shadow atlas tiles: spot light, then the point light cube faces (SHADOW_ATLAS_TILES)
+	mat4 atlasLightSpace[7];
+	// MAX_LIGHTS
+	Light lights[8];
+	// clustered lights: clusters per pixel in x and y, depth slice scale and bias of log(distance)
+	vec4 clusterScale;
+	// grid size, w = 1 to read the cluster lists, 0 to loop over every light
+	ivec4 clusterGrid;
+	int clusterLightCount;
+};
@@ -0,0 +1,30 @@
+#version 410 core
+
+in vec2 fTexCoords;
+in vec3 fNormalEye;
+
+// geometry pass of the deferred path, the lighting is done in deferredLighting.frag
+// albedo, a = the specular colour averaged to one channel
+layout(location=0) out vec4 gAlbedoSpecular;
+// octahedral eye-space normal, mapped to 0..1
+layout(location=1) out vec2 gNormal;
+
+// textures
+uniform sampler2D diffuseTexture;
+uniform sampler2D specularTexture;
+
+vec2 octahedralEncode(vec3 n)
+{
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.xy;
+	if (n.z < 0.0f)
+		e = (1.0f - abs(n.yx)) * vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	return e;
+}
+
+void main() 
+{
+	vec3 specularColor = texture(specularTexture, fTexCoords).rgb;
+	gAlbedoSpecular = vec4(texture(diffuseTexture, fTexCoords).rgb, dot(specularColor, vec3(1.0f / 3.0f)));
+	gNormal = octahedralEncode(normalize(fNormalEye)) * 0.5f + 0.5f;
+}
@@ -1,10 +1,27 @@
 #version 410 core
 layout(location=0) in vec3 vPosition;
-uniform mat4 lightSpaceTrMatrix;
-uniform mat4 model;
+// per-draw transforms (TransformBuffer.hpp), 7 texels each:
+// model matrix with the mesh dequantize folded in, then the normal matrix
+uniform samplerBuffer transforms;
+// first slot of this draw - per instance for pooled multi-draws, a constant attribute value
+// otherwise; the instances of a mesh use consecutive slots
+layout(location=3) in uint vTransform;
 
+mat4 fetchModel()
+{
+	int base = (int(vTransform) + gl_InstanceID) * 7;
+	return mat4(texelFetch(transforms, base), texelFetch(transforms, base + 1),
+		texelFetch(transforms, base + 2), texelFetch(transforms, base + 3));
+}
+
+#include "frameUniforms.glsl"
+
+// cascade being rendered, or the shadow atlas tile when atlasTile >= 0
+uniform int cascade;
+uniform int atlasTile;
 
 void main()
 {
-	gl_Position = lightSpaceTrMatrix * model * vec4(vPosition, 1.0f);
+	mat4 lightSpace = atlasTile >= 0 ? atlasLightSpace[atlasTile] : lightSpaceTrMatrix[cascade];
+	gl_Position = lightSpace * fetchModel() * vec4(vPosition, 1.0f);
 }
\ No newline at end of file
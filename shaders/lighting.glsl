@@ -0,0 +1,228 @@
+// Lighting shared by the forward (basic.frag) and deferred (deferredLighting.frag) paths.
+// The including shader declares fPosEye and fPosWorld, the eye and world space position being lit.
+
+#include "frameUniforms.glsl"
+
+// one layer per cascade
+uniform sampler2DArray shadowMap;
+// the same layers with hardware depth comparison, each fetch is a bilinear 2x2 PCF
+uniform sampler2DArrayShadow shadowMapCompare;
+// blurred and mipmapped exponential variance moments of the layers
+uniform sampler2DArray shadowMoments;
+
+// values of shadowFilter
+const int SHADOW_FILTER_HARD = 0;
+const int SHADOW_FILTER_PCF = 1;
+const int SHADOW_FILTER_EVSM = 2;
+
+// exponents of the positive and negative warps, as in evsmBlur.frag
+const float EVSM_POSITIVE = 40.0f;
+const float EVSM_NEGATIVE = 5.0f;
+// fraction of the Chebyshev bound cut off against light bleeding
+const float EVSM_BLEED_REDUCTION = 0.3f;
+// lamp shadows, ATLAS_COLUMNS x ATLAS_ROWS tiles
+uniform sampler2D shadowAtlas;
+
+const int ATLAS_COLUMNS = 4;
+const int ATLAS_ROWS = 2;
+
+// values of Light.shadow.x
+const int LIGHT_SHADOW_NONE = 0;
+const int LIGHT_SHADOW_CASCADES = 1;
+const int LIGHT_SHADOW_ATLAS = 2;
+const int LIGHT_SHADOW_ATLAS_CUBE = 3;
+
+// clustered point lights (LightClusters.hpp): view space position and radius, then the colour
+uniform samplerBuffer clusterLights;
+// offset and count of each cluster's lights in clusterIndices
+uniform usamplerBuffer clusterRanges;
+uniform usamplerBuffer clusterIndices;
+
+const float specularStrength = 0.5f;
+const float shininess = 32.0f;
+
+// Chebyshev upper bound of the fraction of the filter area closer to the light than mean
+float chebyshevUpperBound(vec2 moments, float mean, float minVariance){
+	if (mean <= moments.x)
+		return 1.0f;
+	float variance = max(moments.y - moments.x * moments.x, minVariance);
+	float d = mean - moments.x;
+	float pMax = variance / (variance + d * d);
+	return clamp((pMax - EVSM_BLEED_REDUCTION) / (1.0f - EVSM_BLEED_REDUCTION), 0.0f, 1.0f);
+}
+
+// cosTheta: between the normal and the direction towards the light, for the slope bias
+float computeShadows(float cosTheta){
+	// the first cascade reaching the fragment's eye-space distance, the last one beyond
+	int cascade = 0;
+	while (cascade < cascadeCount - 1 && -fPosEye.z > cascadeSplits[cascade])
+		cascade++;
+
+	vec4 fPosLightSpace = lightSpaceTrMatrix[cascade] * vec4(fPosWorld, 1.0f);
+	vec3 normalizedCoords = fPosLightSpace.xyz / fPosLightSpace.w;
+	normalizedCoords = normalizedCoords * 0.5 + 0.5;
+	float shadow;
+	if (normalizedCoords.z > 1.0f) {
+		shadow = 0.0f;
+	}
+	else if (shadowFilter == SHADOW_FILTER_EVSM) {
+		// prefiltered, a single trilinear fetch
+		vec4 moments = texture(shadowMoments, vec3(normalizedCoords.xy, cascade));
+		float depth = 2.0f * normalizedCoords.z - 1.0f;
+		float positive = exp(EVSM_POSITIVE * depth);
+		float negative = -exp(-EVSM_NEGATIVE * depth);
+		// minimum variance scaled to each warp's slope
+		float positiveScale = 0.0001f * EVSM_POSITIVE * positive;
+		float negativeScale = 0.0001f * EVSM_NEGATIVE * negative;
+		float lit = min(chebyshevUpperBound(moments.xy, positive, positiveScale * positiveScale),
+			chebyshevUpperBound(moments.zw, negative, negativeScale * negativeScale));
+		shadow = 1.0f - lit;
+	}
+	else if (shadowFilter == SHADOW_FILTER_PCF) {
+		float bias = max(0.05f * (1.0f - cosTheta), 0.005f);
+
+		// 3x3 comparisons of 2x2 texels each
+		vec2 texel = 1.0f / vec2(textureSize(shadowMapCompare, 0).xy);
+		float lit = 0.0f;
+		for (int x = -1; x <= 1; x++)
+			for (int y = -1; y <= 1; y++)
+				lit += texture(shadowMapCompare, vec4(normalizedCoords.xy + vec2(x, y) * texel, cascade, normalizedCoords.z - bias));
+		shadow = 1.0f - lit / 9.0f;
+	}
+	else {
+	
+		float bias = max(0.05f * (1.0f - cosTheta), 0.005f);
+		
+		float closestDepth = texture(shadowMap, vec3(normalizedCoords.xy, cascade)).r;
+		float currentDepth = normalizedCoords.z;
+
+		if(currentDepth - bias > closestDepth)
+			shadow = 1.0f;
+		else shadow = 0.0f;
+	}
+    
+	return shadow;
+}
+
+// 1 if the fragment is hidden from the lamp of atlas tile (0 spot light, 1-6 point light faces)
+float computeAtlasShadow(int tile){
+	vec4 fPosLightSpace = atlasLightSpace[tile] * vec4(fPosWorld, 1.0f);
+	vec3 normalizedCoords = fPosLightSpace.xyz / fPosLightSpace.w * 0.5 + 0.5;
+	if (fPosLightSpace.w <= 0.0f || normalizedCoords.z > 1.0f
+		|| any(lessThan(normalizedCoords.xy, vec2(0.0f))) || any(greaterThan(normalizedCoords.xy, vec2(1.0f))))
+		return 0.0f;
+
+	// stay half a texel inside the tile, the neighbours hold other views
+	vec2 grid = vec2(ATLAS_COLUMNS, ATLAS_ROWS);
+	vec2 halfTexel = 0.5f * grid / vec2(textureSize(shadowAtlas, 0));
+	vec2 tileCoords = clamp(normalizedCoords.xy, halfTexel, 1.0f - halfTexel);
+	vec2 atlasCoords = (vec2(tile % ATLAS_COLUMNS, tile / ATLAS_COLUMNS) + tileCoords) / grid;
+
+	// perspective depth, most of its precision is near the lamp
+	float closestDepth = texture(shadowAtlas, atlasCoords).r;
+	return normalizedCoords.z - 0.0005f > closestDepth ? 1.0f : 0.0f;
+}
+
+// cube face seeing the eye-space offset d from a point light: +x, -x, +y, -y, +z, -z of world space
+int cubeFace(vec3 d){
+	// the view matrix is a rotation and a translation
+	d = transpose(mat3(view)) * d;
+	vec3 a = abs(d);
+	if (a.x >= a.y && a.x >= a.z)
+		return d.x > 0.0f ? 0 : 1;
+	if (a.y >= a.z)
+		return d.y > 0.0f ? 2 : 3;
+	return d.z > 0.0f ? 4 : 5;
+}
+
+// 1 where the light's shadow map hides the fragment
+float computeLightShadow(Light light, float cosTheta){
+	if (light.shadow.x == LIGHT_SHADOW_CASCADES)
+		return computeShadows(cosTheta);
+	if (light.shadow.x == LIGHT_SHADOW_ATLAS)
+		return computeAtlasShadow(light.shadow.y);
+	if (light.shadow.x == LIGHT_SHADOW_ATLAS_CUBE)
+		return computeAtlasShadow(light.shadow.y + cubeFace(fPosEye - light.position.xyz));
+	return 0.0f;
+}
+
+// Blinn-Phong contribution of one light, the material colours are fetched once by the caller
+vec3 computeLight(Light light, vec3 normalEye, vec3 viewDir, vec3 diffuseColor, vec3 specularColor){
+	vec3 lightDirN;
+	float att = 1.0f;
+	if (light.position.w == 0.0f) {
+		lightDirN = light.position.xyz;
+	}
+	else {
+		vec3 toLight = light.position.xyz - fPosEye;
+		float dist = length(toLight);
+		lightDirN = toLight / dist;
+		att = 1.0f / (light.attenuation.x + light.attenuation.y * dist + light.attenuation.z * (dist * dist));
+	}
+
+	// soft edge between the inner and outer cut-off
+	if (light.spot.w > -1.0f) {
+		float theta = dot(-lightDirN, light.spot.xyz);
+		att *= clamp((theta - light.spot.w) / (light.attenuation.w - light.spot.w), 0.0f, 1.0f);
+	}
+	if (att <= 0.0f)
+		return vec3(0.0f);
+
+	float cosTheta = dot(normalEye, lightDirN);
+	vec3 halfVector = normalize(lightDirN + viewDir);
+	float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
+	float lit = 1.0f - computeLightShadow(light, cosTheta);
+
+	vec3 ambient = light.color.a * diffuseColor;
+	vec3 diffuse = lit * max(cosTheta, 0.0f) * diffuseColor;
+	vec3 specular = lit * specularStrength * specCoeff * specularColor;
+	return att * light.color.rgb * (ambient + diffuse + specular);
+}
+
+// diffuse and specular light of clustered light i, nothing beyond its radius
+vec3 computeClusterLight(int i, vec3 normalEye, vec3 viewDir, vec3 diffuseColor, vec3 specularColor){
+	vec4 positionRadius = texelFetch(clusterLights, i * 2);
+	vec3 toLight = positionRadius.xyz - fPosEye;
+	float dist = length(toLight);
+	if (dist >= positionRadius.w)
+		return vec3(0.0f);
+
+	// inverse square, windowed down to zero at the radius
+	float ratio = dist / positionRadius.w;
+	float window = clamp(1.0f - ratio * ratio * ratio * ratio, 0.0f, 1.0f);
+	float att = window * window / (1.0f + 25.0f * ratio * ratio);
+
+	vec3 lightDirN = toLight / dist;
+	vec3 halfVector = normalize(lightDirN + viewDir);
+	float specCoeff = pow(max(dot(normalEye, halfVector), 0.0f), shininess);
+	vec3 diffuse = max(dot(normalEye, lightDirN), 0.0f) * diffuseColor;
+	vec3 specular = specularStrength * specCoeff * specularColor;
+	return att * texelFetch(clusterLights, i * 2 + 1).rgb * (diffuse + specular);
+}
+
+// colour of the fragment at fPosEye under every light, the material fetched by the caller
+vec3 shadeFragment(vec3 normalEye, vec3 diffuseColor, vec3 specularColor){
+	vec3 viewDir = normalize(-fPosEye);
+
+	vec3 color = vec3(0.0f);
+	for (int i = 0; i < lightCount; i++)
+		color += computeLight(lights[i], normalEye, viewDir, diffuseColor, specularColor);
+
+	if (clusterGrid.w != 0) {
+		// only the lights binned into this fragment's cluster
+		ivec3 cluster = ivec3(vec3(gl_FragCoord.xy * clusterScale.xy, log(-fPosEye.z) * clusterScale.z + clusterScale.w));
+		cluster = clamp(cluster, ivec3(0), clusterGrid.xyz - 1);
+		int index = (cluster.z * clusterGrid.y + cluster.y) * clusterGrid.x + cluster.x;
+		uvec2 range = texelFetch(clusterRanges, index).xy;
+		for (uint i = 0u; i < range.y; i++) {
+			int light = int(texelFetch(clusterIndices, int(range.x + i)).r);
+			color += computeClusterLight(light, normalEye, viewDir, diffuseColor, specularColor);
+		}
+	}
+	else {
+		for (int i = 0; i < clusterLightCount; i++)
+			color += computeClusterLight(i, normalEye, viewDir, diffuseColor, specularColor);
+	}
+
+	return min(color, 1.0f);
+}
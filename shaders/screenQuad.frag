@@ -4,10 +4,11 @@ in vec2 fTexCoords;
 
 out vec4 fColor;
 
-uniform sampler2D depthMap;
+// shadow map cascades, the first one is shown
+uniform sampler2DArray depthMap;
 
 void main() 
 {    
-    fColor = vec4(vec3(texture(depthMap, fTexCoords).r), 1.0f);
+    fColor = vec4(vec3(texture(depthMap, vec3(fTexCoords, 0.0f)).r), 1.0f);
     //fColor = vec4(fTexCoords, 0.0f, 1.0f);
 }
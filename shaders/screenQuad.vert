@@ -6,8 +6,11 @@ layout(location=2) in vec2 vTexCoords;
 
 out vec2 fTexCoords;
 
+// only the dequantize matrix of packed vertices
+uniform mat4 model;
+
 void main() 
 {
 	fTexCoords = vTexCoords;
-	gl_Position = vec4(vPosition, 1.0f);
+	gl_Position = model * vec4(vPosition, 1.0f);
 }
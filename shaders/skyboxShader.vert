@@ -3,13 +3,12 @@
 layout (location = 0) in vec3 vertexPosition;
 out vec3 textureCoordinates;
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform mat4 model;
+#include "frameUniforms.glsl"
 
 void main()
 {
-    vec4 tempPos = projection * view * vec4(vertexPosition, 1.0);
+    // the skybox follows the camera rotation only
+    vec4 tempPos = projection * mat4(mat3(view)) * vec4(vertexPosition, 1.0);
     gl_Position = tempPos.xyww;
     textureCoordinates = vertexPosition;
 }
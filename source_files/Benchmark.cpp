@@ -0,0 +1,99 @@
+#include "Benchmark.hpp"
+
+#include "tiny_obj_loader.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace gps {
+
+    // Builds a grid mesh split into several objects and materials, so the
+    // stitching of shape boundaries is exercised as well
+    static std::string MakeSyntheticObj(size_t faceCount) {
+        size_t side = 2;
+        while ((side - 1) * (side - 1) * 2 < faceCount)
+            side++;
+
+        std::string obj;
+        obj.reserve(faceCount * 64);
+        char line[160];
+
+        for (size_t y = 0; y < side; y++) {
+            for (size_t x = 0; x < side; x++) {
+                snprintf(line, sizeof(line), "v %.6f %.6f %.6f\nvn 0.000000 1.000000 0.000000\nvt %.6f %.6f\n",
+                    x * 0.01f, (x * 7 + y * 13) % 17 * 0.001f, y * 0.01f,
+                    x / float(side - 1), y / float(side - 1));
+                obj += line;
+            }
+        }
+
+        const size_t rowsPerObject = std::max<size_t>(1, (side - 1) / 16);
+        size_t faces = 0;
+        for (size_t y = 0; y + 1 < side && faces < faceCount; y++) {
+            if (y % rowsPerObject == 0) {
+                snprintf(line, sizeof(line), "o part%zu\nusemtl material%zu\n", y / rowsPerObject, (y / rowsPerObject) % 4);
+                obj += line;
+            }
+            for (size_t x = 0; x + 1 < side && faces < faceCount; x++) {
+                size_t a = y * side + x + 1;
+                size_t b = a + 1;
+                size_t c = a + side;
+                size_t d = c + 1;
+                snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a, a, b, b, b, d, d, d);
+                obj += line;
+                faces++;
+                if (faces < faceCount) {
+                    snprintf(line, sizeof(line), "f %zu/%zu/%zu %zu/%zu/%zu %zu/%zu/%zu\n", a, a, a, d, d, d, c, c, c);
+                    obj += line;
+                    faces++;
+                }
+            }
+        }
+
+        return obj;
+    }
+
+    void BenchmarkObjParsing(size_t faceCount) {
+        std::string obj = MakeSyntheticObj(faceCount);
+        std::cout << "OBJ parse benchmark: " << faceCount << " faces, "
+            << obj.size() / (1024 * 1024) << " MB" << std::endl;
+
+        unsigned int maxThreads = std::max(1u, std::thread::hardware_concurrency());
+        double baseline = 0.0;
+
+        for (unsigned int threads = 1; ; threads = std::min(threads * 2, maxThreads)) {
+            // best of three, the first run also warms up the allocator
+            double best = 0.0;
+            size_t indexCount = 0;
+            for (int run = 0; run < 3; run++) {
+                tinyobj::attrib_t attrib;
+                std::vector<tinyobj::shape_t> shapes;
+                std::vector<tinyobj::material_t> materials;
+                std::string err;
+
+                auto start = std::chrono::high_resolution_clock::now();
+                tinyobj::LoadObjFromBuffer(&attrib, &shapes, &materials, &err, obj.data(), obj.size(), NULL, true, threads);
+                double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+                if (run == 0 || ms < best)
+                    best = ms;
+                indexCount = 0;
+                for (size_t i = 0; i < shapes.size(); i++)
+                    indexCount += shapes[i].mesh.indices.size();
+            }
+
+            if (threads == 1)
+                baseline = best;
+            std::cout << "  " << threads << " thread(s): " << best << " ms, speedup "
+                << baseline / best << "x (" << indexCount / 3 << " faces)" << std::endl;
+
+            if (threads == maxThreads)
+                break;
+        }
+    }
+}
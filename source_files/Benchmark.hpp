@@ -0,0 +1,13 @@
+#ifndef Benchmark_hpp
+#define Benchmark_hpp
+
+#include <cstddef>
+
+namespace gps {
+
+    // Parses a synthetic .obj with `faceCount` triangles using 1, 2, 4 ... threads
+    // (up to the core count) and prints the time and speedup of each run
+    void BenchmarkObjParsing(size_t faceCount);
+}
+
+#endif /* Benchmark_hpp */
@@ -0,0 +1,130 @@
+#include "Culling.hpp"
+
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+namespace gps {
+
+    void BoundsBatch::clear()
+    {
+        centerX.clear(); centerY.clear(); centerZ.clear();
+        extentX.clear(); extentY.clear(); extentZ.clear();
+    }
+
+    // world axis aligned box of the model space box moved by transform (Arvo)
+    static void transformBox(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform,
+                             glm::vec3& center, glm::vec3& extent)
+    {
+        center = glm::vec3(transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1.0f));
+        glm::vec3 halfSize = (boundsMax - boundsMin) * 0.5f;
+
+        extent = glm::vec3(0.0f);
+        for (int axis = 0; axis < 3; axis++) {
+            for (int column = 0; column < 3; column++)
+                extent[axis] += std::fabs(transform[column][axis]) * halfSize[column];
+        }
+    }
+
+    void BoundsBatch::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform)
+    {
+        add(boundsMin, boundsMax, &transform, 1);
+    }
+
+    void BoundsBatch::add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4* transforms, size_t count)
+    {
+        glm::vec3 center, extent;
+        transformBox(boundsMin, boundsMax, transforms[0], center, extent);
+
+        if (count > 1) {
+            glm::vec3 unionMin = center - extent;
+            glm::vec3 unionMax = center + extent;
+            for (size_t i = 1; i < count; i++) {
+                transformBox(boundsMin, boundsMax, transforms[i], center, extent);
+                unionMin = glm::min(unionMin, center - extent);
+                unionMax = glm::max(unionMax, center + extent);
+            }
+            center = (unionMin + unionMax) * 0.5f;
+            extent = (unionMax - unionMin) * 0.5f;
+        }
+
+        centerX.push_back(center.x); centerY.push_back(center.y); centerZ.push_back(center.z);
+        extentX.push_back(extent.x); extentY.push_back(extent.y); extentZ.push_back(extent.z);
+    }
+
+    size_t BoundsBatch::size() const
+    {
+        return centerX.size();
+    }
+
+    bool BoundsBatch::enclose(glm::vec3& boundsMin, glm::vec3& boundsMax) const
+    {
+        if (centerX.empty())
+            return false;
+
+        boundsMin = glm::vec3(centerX[0] - extentX[0], centerY[0] - extentY[0], centerZ[0] - extentZ[0]);
+        boundsMax = glm::vec3(centerX[0] + extentX[0], centerY[0] + extentY[0], centerZ[0] + extentZ[0]);
+        for (size_t i = 1; i < centerX.size(); i++) {
+            boundsMin = glm::min(boundsMin, glm::vec3(centerX[i] - extentX[i], centerY[i] - extentY[i], centerZ[i] - extentZ[i]));
+            boundsMax = glm::max(boundsMax, glm::vec3(centerX[i] + extentX[i], centerY[i] + extentY[i], centerZ[i] + extentZ[i]));
+        }
+        return true;
+    }
+
+    void BoundsBatch::cull(const glm::mat4& viewProjection, std::vector<unsigned char>& visible) const
+    {
+        // Gribb-Hartmann planes: left, right, bottom, top, near, far
+        // a box is outside if it lies entirely on the negative side of one plane
+        glm::vec4 planes[6];
+        for (int i = 0; i < 3; i++) {
+            glm::vec4 row(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+            glm::vec4 w(viewProjection[0][3], viewProjection[1][3], viewProjection[2][3], viewProjection[3][3]);
+            planes[2 * i] = w + row;
+            planes[2 * i + 1] = w - row;
+        }
+
+        size_t count = size();
+        visible.resize(count);
+        size_t i = 0;
+
+#ifdef CULLING_SSE
+        const __m128 zero = _mm_setzero_ps();
+        for (; i + 4 <= count; i += 4) {
+            __m128 cx = _mm_loadu_ps(&centerX[i]);
+            __m128 cy = _mm_loadu_ps(&centerY[i]);
+            __m128 cz = _mm_loadu_ps(&centerZ[i]);
+            __m128 ex = _mm_loadu_ps(&extentX[i]);
+            __m128 ey = _mm_loadu_ps(&extentY[i]);
+            __m128 ez = _mm_loadu_ps(&extentZ[i]);
+            __m128 inside = _mm_cmpeq_ps(zero, zero);
+
+            for (int p = 0; p < 6; p++) {
+                __m128 distance = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(cx, _mm_set1_ps(planes[p].x)), _mm_mul_ps(cy, _mm_set1_ps(planes[p].y))),
+                    _mm_add_ps(_mm_mul_ps(cz, _mm_set1_ps(planes[p].z)), _mm_set1_ps(planes[p].w)));
+                __m128 radius = _mm_add_ps(
+                    _mm_add_ps(_mm_mul_ps(ex, _mm_set1_ps(std::fabs(planes[p].x))), _mm_mul_ps(ey, _mm_set1_ps(std::fabs(planes[p].y)))),
+                    _mm_mul_ps(ez, _mm_set1_ps(std::fabs(planes[p].z))));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, radius), zero));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++)
+                visible[i + k] = (unsigned char)((mask >> k) & 1);
+        }
+#endif
+
+        for (; i < count; i++) {
+            bool inside = true;
+            for (int p = 0; p < 6 && inside; p++) {
+                float distance = planes[p].x * centerX[i] + planes[p].y * centerY[i] + planes[p].z * centerZ[i] + planes[p].w;
+                float radius = std::fabs(planes[p].x) * extentX[i] + std::fabs(planes[p].y) * extentY[i] + std::fabs(planes[p].z) * extentZ[i];
+                inside = distance + radius >= 0.0f;
+            }
+            visible[i] = inside ? 1 : 0;
+        }
+    }
+}
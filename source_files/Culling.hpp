@@ -0,0 +1,38 @@
+#ifndef Culling_hpp
+#define Culling_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // World space axis aligned boxes stored as structure of arrays, so the
+    // frustum test can check four boxes per SIMD instruction
+    class BoundsBatch
+    {
+    public:
+        void clear();
+
+        // Adds the box enclosing the model space box [boundsMin, boundsMax] moved by transform
+        void add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform);
+
+        // Adds one box enclosing the model space box moved by each of the transforms
+        void add(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4* transforms, size_t count);
+
+        size_t size() const;
+
+        // Box enclosing all the boxes, false when there are none
+        bool enclose(glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+
+        // Sets visible[i] to 1 if box i is at least partly inside the frustum of viewProjection
+        void cull(const glm::mat4& viewProjection, std::vector<unsigned char>& visible) const;
+
+    private:
+        std::vector<float> centerX, centerY, centerZ;
+        std::vector<float> extentX, extentY, extentZ;
+    };
+}
+
+#endif /* Culling_hpp */
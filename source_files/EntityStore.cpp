@@ -0,0 +1,94 @@
+#include "EntityStore.hpp"
+
+#include "glm/gtc/matrix_inverse.hpp"
+
+namespace gps {
+
+    EntityStore::Entity EntityStore::create(gps::Model3D* model, const glm::mat4& local, uint32_t group, bool dynamic)
+    {
+        // right after the last entity of the same run, at the end for a new one
+        size_t position = models.size();
+        for (size_t i = models.size(); i > 0; i--) {
+            if (models[i - 1] == model && groups[i - 1] == group && this->dynamic[i - 1] == dynamic) {
+                position = i;
+                break;
+            }
+        }
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            if (indices[i] >= position)
+                indices[i]++;
+        }
+        indices.push_back((uint32_t)position);
+
+        this->local.insert(this->local.begin() + position, local);
+        world.insert(world.begin() + position, glm::mat4(1.0f));
+        normal.insert(normal.begin() + position, glm::mat3(1.0f));
+        models.insert(models.begin() + position, model);
+        groups.insert(groups.begin() + position, group);
+        this->dynamic.insert(this->dynamic.begin() + position, dynamic);
+        dirty.insert(dirty.begin() + position, 1);
+        dirtyCount++;
+
+        buildRuns();
+        return (Entity)(indices.size() - 1);
+    }
+
+    void EntityStore::buildRuns()
+    {
+        entityRuns.clear();
+        for (size_t i = 0; i < models.size(); i++) {
+            if (i > 0 && models[i] == models[i - 1] && groups[i] == groups[i - 1] && dynamic[i] == dynamic[i - 1])
+                entityRuns.back().count++;
+            else
+                entityRuns.push_back({ models[i], (uint32_t)i, 1, true, dynamic[i] != 0 });
+        }
+    }
+
+    void EntityStore::setLocal(Entity entity, const glm::mat4& local)
+    {
+        uint32_t i = indices[entity];
+        this->local[i] = local;
+        if (!dirty[i]) {
+            dirty[i] = 1;
+            dirtyCount++;
+        }
+    }
+
+    void EntityStore::setRoot(const glm::mat4& root)
+    {
+        if (root == this->root)
+            return;
+        this->root = root;
+        for (size_t i = 0; i < dirty.size(); i++)
+            dirty[i] = 1;
+        dirtyCount = dirty.size();
+    }
+
+    size_t EntityStore::update()
+    {
+        for (size_t r = 0; r < entityRuns.size(); r++)
+            entityRuns[r].modified = false;
+        staticChanged = false;
+        if (dirtyCount == 0)
+            return 0;
+
+        for (size_t r = 0; r < entityRuns.size(); r++) {
+            Run& run = entityRuns[r];
+            for (uint32_t i = run.first; i < run.first + run.count; i++) {
+                if (!dirty[i])
+                    continue;
+                world[i] = root * local[i];
+                normal[i] = glm::inverseTranspose(glm::mat3(world[i]));
+                dirty[i] = 0;
+                run.modified = true;
+            }
+            if (run.modified && !run.dynamic)
+                staticChanged = true;
+        }
+
+        size_t updated = dirtyCount;
+        dirtyCount = 0;
+        return updated;
+    }
+}
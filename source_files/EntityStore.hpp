@@ -0,0 +1,75 @@
+#ifndef EntityStore_hpp
+#define EntityStore_hpp
+
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    class Model3D;
+
+    // Scene objects stored as structure of arrays. World and normal matrices are cached
+    // and recomputed by update() only for the entities whose local transform or root changed.
+    // Entities with the same model, group and dynamic flag sit next to each other and form
+    // one run, drawn with a single instanced draw per mesh.
+    class EntityStore
+    {
+    public:
+        typedef uint32_t Entity;
+
+        // Consecutive entities sharing a model
+        struct Run {
+            gps::Model3D* model;
+            uint32_t first;
+            uint32_t count;
+            // a world matrix of the run changed in the last update()
+            bool modified;
+            // animated entities, kept out of cached shadow maps
+            bool dynamic;
+        };
+
+        // Adds an entity placed at local relative to the root - init time, moves the arrays around
+        Entity create(gps::Model3D* model, const glm::mat4& local, uint32_t group = 0, bool dynamic = false);
+
+        void setLocal(Entity entity, const glm::mat4& local);
+
+        // Transform applied on top of every local one, dirties the whole store when it changes
+        void setRoot(const glm::mat4& root);
+
+        // Recomputes the world and normal matrices of the dirty entities, returns how many
+        size_t update();
+
+        // a static entity's world matrix changed in the last update()
+        bool staticModified() const { return staticChanged; }
+
+        size_t size() const { return models.size(); }
+        const std::vector<Run>& runs() const { return entityRuns; }
+
+        const glm::mat4* worldMatrices() const { return world.data(); }
+        const glm::mat3* normalMatrices() const { return normal.data(); }
+
+    private:
+        // indexed by position, sorted by (group, model)
+        std::vector<glm::mat4> local;
+        std::vector<glm::mat4> world;
+        std::vector<glm::mat3> normal;
+        std::vector<gps::Model3D*> models;
+        std::vector<uint32_t> groups;
+        std::vector<unsigned char> dynamic;
+        std::vector<unsigned char> dirty;
+        // position of each entity
+        std::vector<uint32_t> indices;
+
+        std::vector<Run> entityRuns;
+        glm::mat4 root = glm::mat4(1.0f);
+        size_t dirtyCount = 0;
+        bool staticChanged = false;
+
+        void buildRuns();
+    };
+}
+
+#endif /* EntityStore_hpp */
@@ -0,0 +1,19 @@
+#include "FrameUniforms.hpp"
+
+namespace gps {
+
+    void FrameUniformBuffer::create()
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), NULL, GL_STREAM_DRAW);
+        glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, buffer);
+    }
+
+    void FrameUniformBuffer::update(const FrameUniforms& data)
+    {
+        // respecifying the storage lets the driver orphan the copy the last frame still reads
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), &data, GL_STREAM_DRAW);
+    }
+}
@@ -0,0 +1,117 @@
+#ifndef FrameUniforms_hpp
+#define FrameUniforms_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <cstddef>
+
+namespace gps {
+
+    // Uniform block shared by every program that declares it, attached at link time
+    const char* const FRAME_UNIFORMS_BLOCK = "FrameUniforms";
+    const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+    // Directional shadow cascades, the array size in the shaders' block
+    const int MAX_SHADOW_CASCADES = 4;
+
+    // Lamp shadow atlas tiles: the spot light, then the six cube faces of the point light
+    const int SHADOW_ATLAS_TILES = 7;
+
+    // Filtering of the directional shadows (FrameUniforms::shadowFilter), same values in lighting.glsl
+    enum ShadowFilter {
+        // one depth comparison
+        SHADOW_FILTER_HARD,
+        // 3x3 hardware comparisons through a sampler2DArrayShadow
+        SHADOW_FILTER_PCF,
+        // one filtered fetch of the blurred, mipmapped exponential variance moments
+        SHADOW_FILTER_EVSM,
+        SHADOW_FILTER_COUNT
+    };
+
+    // Lights of the shaders' light loop, the array size in the block
+    const int MAX_LIGHTS = 8;
+
+    // Shadow map a light reads (GpuLight::shadow.x), same values in lighting.glsl
+    enum LightShadow {
+        LIGHT_SHADOW_NONE,
+        // the directional cascades
+        LIGHT_SHADOW_CASCADES,
+        // one shadow atlas tile
+        LIGHT_SHADOW_ATLAS,
+        // six shadow atlas tiles, one per cube face
+        LIGHT_SHADOW_ATLAS_CUBE
+    };
+
+    // CPU copy of the std140 Light struct in shaders/frameUniforms.glsl
+    struct GpuLight {
+        // eye space, w = 0 for a directional light whose xyz is the direction towards it
+        glm::vec4 position;
+        // rgb, a = ambient strength
+        glm::vec4 color;
+        // eye-space direction of a spot light, w = cosine of the outer cut-off (-1 without a cone)
+        glm::vec4 spot;
+        // constant, linear and quadratic falloff, w = cosine of the inner cut-off
+        glm::vec4 attenuation;
+        // x = LightShadow, y = first shadow atlas tile
+        glm::ivec4 shadow;
+    };
+
+    static_assert(sizeof(GpuLight) == 80, "GpuLight std140 layout");
+
+    // CPU copy of the std140 FrameUniforms block in shaders/frameUniforms.glsl - keep both in sync.
+    // vec3 members take a whole 16-byte slot in std140.
+    struct FrameUniforms {
+        glm::mat4 view;
+        glm::mat4 projection;
+        // one per cascade, the unused ones are left as they were
+        glm::mat4 lightSpaceTrMatrix[MAX_SHADOW_CASCADES];
+        // eye-space distance where each cascade ends
+        glm::vec4 cascadeSplits;
+        GLint cascadeCount;
+        GLint shadowFilter;
+        GLint lightCount;
+        GLint pad0;
+        // light space matrix of each shadow atlas tile
+        glm::mat4 atlasLightSpace[SHADOW_ATLAS_TILES];
+        // the first lightCount are lit
+        GpuLight lights[MAX_LIGHTS];
+        // clustered lights (LightClusters.hpp): clusters per pixel in x and y, then the depth
+        // slice scale and bias of log(eye-space distance)
+        glm::vec4 clusterScale;
+        // cluster grid size, w = 1 to read the cluster lists, 0 to loop over every light
+        glm::ivec4 clusterGrid;
+        GLint clusterLightCount;
+        GLint pad1[3];
+    };
+
+    static_assert(offsetof(FrameUniforms, view) == 0, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, projection) == 64, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, lightSpaceTrMatrix) == 128, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, cascadeSplits) == 384, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, cascadeCount) == 400, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, shadowFilter) == 404, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, lightCount) == 408, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, atlasLightSpace) == 416, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, lights) == 864, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, clusterScale) == 1504, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, clusterGrid) == 1520, "FrameUniforms std140 layout");
+    static_assert(offsetof(FrameUniforms, clusterLightCount) == 1536, "FrameUniforms std140 layout");
+    static_assert(sizeof(FrameUniforms) == 1552, "FrameUniforms std140 layout");
+
+    // Uniform buffer holding the FrameUniforms block
+    class FrameUniformBuffer
+    {
+    public:
+        // Allocates the buffer and attaches it to FRAME_UNIFORMS_BINDING - needs the GL context
+        void create();
+
+        // Replaces the whole block, once per frame before the first pass
+        void update(const FrameUniforms& data);
+
+    private:
+        GLuint buffer = 0;
+    };
+}
+
+#endif /* FrameUniforms_hpp */
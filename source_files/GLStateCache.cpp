@@ -0,0 +1,134 @@
+#include "GLStateCache.hpp"
+
+namespace gps {
+
+    GLStateCache glState;
+
+    // never a valid name/enum, so the first call of each kind is always issued
+    static const GLuint UNKNOWN = ~0u;
+
+    GLStateCache::GLStateCache()
+    {
+        invalidate();
+        issued = skipped = 0;
+        previousIssued = previousSkipped = 0;
+    }
+
+    void GLStateCache::invalidate()
+    {
+        program = UNKNOWN;
+        vertexArray = UNKNOWN;
+        activeUnit = UNKNOWN;
+        for (int i = 0; i < MAX_TEXTURE_UNITS; i++) {
+            textures2D[i] = UNKNOWN;
+            textures2DArray[i] = UNKNOWN;
+            texturesCube[i] = UNKNOWN;
+        }
+        depthFunction = UNKNOWN;
+        depthTestEnabled = -1;
+        viewportRect[0] = viewportRect[1] = viewportRect[2] = viewportRect[3] = -1;
+    }
+
+    void GLStateCache::beginFrame()
+    {
+        previousIssued = issued;
+        previousSkipped = skipped;
+        issued = skipped = 0;
+    }
+
+    void GLStateCache::useProgram(GLuint program)
+    {
+        if (this->program == program) {
+            skipped++;
+            return;
+        }
+        glUseProgram(program);
+        this->program = program;
+        issued++;
+    }
+
+    void GLStateCache::bindVertexArray(GLuint vertexArray)
+    {
+        if (this->vertexArray == vertexArray) {
+            skipped++;
+            return;
+        }
+        glBindVertexArray(vertexArray);
+        this->vertexArray = vertexArray;
+        issued++;
+    }
+
+    void GLStateCache::activeTexture(GLuint unit)
+    {
+        if (activeUnit == unit) {
+            skipped++;
+            return;
+        }
+        glActiveTexture(GL_TEXTURE0 + unit);
+        activeUnit = unit;
+        issued++;
+    }
+
+    void GLStateCache::bindTexture(GLuint unit, GLenum target, GLuint texture)
+    {
+        GLuint* bound = NULL;
+        if (unit < MAX_TEXTURE_UNITS) {
+            if (target == GL_TEXTURE_2D)
+                bound = &textures2D[unit];
+            else if (target == GL_TEXTURE_2D_ARRAY)
+                bound = &textures2DArray[unit];
+            else if (target == GL_TEXTURE_CUBE_MAP)
+                bound = &texturesCube[unit];
+        }
+
+        if (bound && *bound == texture) {
+            skipped++;
+            return;
+        }
+
+        activeTexture(unit);
+        glBindTexture(target, texture);
+        if (bound)
+            *bound = texture;
+        issued++;
+    }
+
+    void GLStateCache::depthFunc(GLenum func)
+    {
+        if (depthFunction == func) {
+            skipped++;
+            return;
+        }
+        glDepthFunc(func);
+        depthFunction = func;
+        issued++;
+    }
+
+    void GLStateCache::depthTest(bool enabled)
+    {
+        if (depthTestEnabled == (int)enabled) {
+            skipped++;
+            return;
+        }
+        if (enabled)
+            glEnable(GL_DEPTH_TEST);
+        else
+            glDisable(GL_DEPTH_TEST);
+        depthTestEnabled = (int)enabled;
+        issued++;
+    }
+
+    void GLStateCache::viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+    {
+        if (viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width && viewportRect[3] == height) {
+            skipped++;
+            return;
+        }
+        glViewport(x, y, width, height);
+        viewportRect[0] = x;
+        viewportRect[1] = y;
+        viewportRect[2] = width;
+        viewportRect[3] = height;
+        issued++;
+    }
+}
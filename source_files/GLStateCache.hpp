@@ -0,0 +1,62 @@
+#ifndef GLStateCache_hpp
+#define GLStateCache_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+namespace gps {
+
+    // Shadows the GL state the renderer changes per draw and drops calls that
+    // would not change it. Everything that binds programs, vertex arrays or
+    // textures during a frame has to go through it (or call invalidate()).
+    class GLStateCache
+    {
+    public:
+        static const int MAX_TEXTURE_UNITS = 16;
+
+        GLStateCache();
+
+        void useProgram(GLuint program);
+        void bindVertexArray(GLuint vertexArray);
+        // GL_TEXTURE_2D, GL_TEXTURE_2D_ARRAY and GL_TEXTURE_CUBE_MAP are tracked, other targets always go through
+        void bindTexture(GLuint unit, GLenum target, GLuint texture);
+        // Selects unit for calls on the texture bound there (glGenerateMipmap, glTexImage*) -
+        // bindTexture skips it when the texture is already bound
+        void activeTexture(GLuint unit);
+        void depthFunc(GLenum func);
+        void depthTest(bool enabled);
+        void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+
+        // Forget everything, for code that changed the state behind the cache's back
+        void invalidate();
+
+        // Starts counting the calls of a new frame
+        void beginFrame();
+
+        // GL calls issued and skipped by the cache in the last finished frame
+        size_t lastFrameIssued() const { return previousIssued; }
+        size_t lastFrameSkipped() const { return previousSkipped; }
+
+    private:
+        GLuint program;
+        GLuint vertexArray;
+        GLuint activeUnit;
+        GLuint textures2D[MAX_TEXTURE_UNITS];
+        GLuint textures2DArray[MAX_TEXTURE_UNITS];
+        GLuint texturesCube[MAX_TEXTURE_UNITS];
+        GLenum depthFunction;
+        int depthTestEnabled;
+        GLint viewportRect[4];
+
+        size_t issued;
+        size_t skipped;
+        size_t previousIssued;
+        size_t previousSkipped;
+    };
+
+    // State of the window's context
+    extern GLStateCache glState;
+}
+
+#endif /* GLStateCache_hpp */
@@ -0,0 +1,138 @@
+#include "GeometryPool.hpp"
+#include "GLStateCache.hpp"
+#include "Mesh.hpp"
+
+#include <cstring>
+
+namespace gps {
+
+    GeometryPool geometryPool;
+
+    void GeometryPool::add(const void* vertices, const void* positions, size_t vertexCount, size_t vertexSize,
+                           size_t positionSize, const std::vector<GLuint>& indices, GLenum indexType,
+                           GLint& baseVertex, GLuint& firstIndex)
+    {
+        this->vertexSize = vertexSize;
+        baseVertex = (GLint)(vertexData.size() / vertexSize);
+        bool shortIndices = indexType == GL_UNSIGNED_SHORT;
+        firstIndex = (GLuint)(shortIndices ? shortIndexData.size() : indexData.size());
+
+        size_t offset = vertexData.size();
+        vertexData.resize(offset + vertexCount * vertexSize);
+        size_t positionOffset = positionData.size();
+        positionData.resize(positionOffset + vertexCount * positionSize);
+        if (vertexCount) {
+            memcpy(&vertexData[offset], vertices, vertexCount * vertexSize);
+            memcpy(&positionData[positionOffset], positions, vertexCount * positionSize);
+        }
+        if (shortIndices)
+            shortIndexData.insert(shortIndexData.end(), indices.begin(), indices.end());
+        else
+            indexData.insert(indexData.end(), indices.begin(), indices.end());
+    }
+
+    void GeometryPool::upload()
+    {
+        // indirect commands with a non-zero baseInstance need GL 4.3 or the two extensions
+        useIndirect = GLEW_ARB_multi_draw_indirect && GLEW_ARB_base_instance;
+
+        glGenBuffers(1, &vbo);
+        glGenBuffers(1, &positionVbo);
+        glGenBuffers(1, &ebo);
+        glGenBuffers(1, &shortEbo);
+        glGenBuffers(1, &indirectBuffer);
+        glGenBuffers(1, &transformBuffer);
+
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBufferData(GL_ARRAY_BUFFER, vertexData.size(), vertexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+        glBufferData(GL_ARRAY_BUFFER, positionData.size(), positionData.data(), GL_STATIC_DRAW);
+
+        // the element buffer binding is vertex array state, each index buffer gets its own pair
+        glState.bindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexData.size() * sizeof(GLuint), indexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, shortEbo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndexData.size() * sizeof(GLushort), shortIndexData.data(), GL_STATIC_DRAW);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+        createVertexArrays(ebo, vao, depthVao);
+        createVertexArrays(shortEbo, shortVao, shortDepthVao);
+
+        glState.bindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+        std::vector<unsigned char>().swap(vertexData);
+        std::vector<unsigned char>().swap(positionData);
+        std::vector<GLuint>().swap(indexData);
+        std::vector<GLushort>().swap(shortIndexData);
+    }
+
+    void GeometryPool::createVertexArrays(GLuint elementBuffer, GLuint& vertexArray, GLuint& depthVertexArray)
+    {
+        glGenVertexArrays(1, &vertexArray);
+        glState.bindVertexArray(vertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, vbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        Mesh::setVertexAttributes(Mesh::packedVertices);
+        setTransformAttribute();
+
+        // same indices and transform slots, positions only
+        glGenVertexArrays(1, &depthVertexArray);
+        glState.bindVertexArray(depthVertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
+        Mesh::setPositionAttribute(Mesh::packedVertices);
+        setTransformAttribute();
+    }
+
+    void GeometryPool::setTransformAttribute()
+    {
+        if (!useIndirect)
+            return;
+        glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+        glEnableVertexAttribArray(TRANSFORM_ATTRIBUTE);
+        glVertexAttribIPointer(TRANSFORM_ATTRIBUTE, 1, GL_UNSIGNED_INT, sizeof(GLuint), (GLvoid*)0);
+        glVertexAttribDivisor(TRANSFORM_ATTRIBUTE, 1);
+    }
+
+    void GeometryPool::setDraws(const std::vector<DrawElementsIndirectCommand>& commands,
+                                const std::vector<GLuint>& transformSlots)
+    {
+        if (!useIndirect) {
+            this->commands = commands;
+            this->transformSlots = transformSlots;
+            return;
+        }
+
+        // orphan the previous pass's data instead of waiting for it
+        glBindBuffer(GL_DRAW_INDIRECT_BUFFER, indirectBuffer);
+        glBufferData(GL_DRAW_INDIRECT_BUFFER, commands.size() * sizeof(DrawElementsIndirectCommand),
+                     commands.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, transformBuffer);
+        glBufferData(GL_ARRAY_BUFFER, transformSlots.size() * sizeof(GLuint), transformSlots.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+
+    size_t GeometryPool::multiDraw(size_t first, size_t count, GLenum indexType, bool depthOnly)
+    {
+        if (count == 0)
+            return 0;
+
+        glState.bindVertexArray(depthOnly ? depthVertexArray(indexType) : vertexArray(indexType));
+        if (useIndirect) {
+            glMultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                (GLvoid*)(first * sizeof(DrawElementsIndirectCommand)), (GLsizei)count, 0);
+            return 1;
+        }
+
+        size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+        for (size_t i = first; i < first + count; i++) {
+            const DrawElementsIndirectCommand& command = commands[i];
+            glVertexAttribI1ui(TRANSFORM_ATTRIBUTE, transformSlots[command.baseInstance]);
+            glDrawElementsInstancedBaseVertex(GL_TRIANGLES, command.count, indexType,
+                (GLvoid*)(command.firstIndex * indexSize), command.instanceCount, command.baseVertex);
+        }
+        return count;
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef GeometryPool_hpp
+#define GeometryPool_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Same layout as the GL indirect draw command
+    struct DrawElementsIndirectCommand {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint baseVertex;
+        GLuint baseInstance;
+    };
+
+    // One vertex buffer shared by every mesh (Mesh::pooledGeometry), plus a position-only buffer
+    // for the depth pass. Indices go to a 16-bit or a 32-bit index buffer, each read through its
+    // own vertex array and depth vertex array; the commands of one multi-draw share one of them. A pass is drawn with glMultiDrawElementsIndirect; each command's
+    // baseInstance picks its transform slot through an instanced attribute. Drivers without
+    // indirect/base instance support get one glDrawElementsInstancedBaseVertex per command instead.
+    class GeometryPool
+    {
+    public:
+        // Vertex attribute carrying the transform slot (basic.vert, lightSpaceShader.vert)
+        static const GLuint TRANSFORM_ATTRIBUTE = 3;
+
+        // Appends a mesh's vertices (all of one format), their positions and indices, returns where
+        // they start - both streams share baseVertex, firstIndex counts in the buffer of indexType
+        // (GL_UNSIGNED_SHORT needs at most 65536 vertices)
+        void add(const void* vertices, const void* positions, size_t vertexCount, size_t vertexSize,
+                 size_t positionSize, const std::vector<GLuint>& indices, GLenum indexType,
+                 GLint& baseVertex, GLuint& firstIndex);
+
+        // Creates the GL objects from everything added so far and frees the CPU copies
+        void upload();
+
+        // Vertex arrays over the index buffer of indexType
+        GLuint vertexArray(GLenum indexType) const { return indexType == GL_UNSIGNED_SHORT ? shortVao : vao; }
+        GLuint depthVertexArray(GLenum indexType) const { return indexType == GL_UNSIGNED_SHORT ? shortDepthVao : depthVao; }
+
+        // Uploads a pass's commands; baseInstance indexes transformSlots, which holds the
+        // command's first slot once per instance (the attribute advances per instance)
+        void setDraws(const std::vector<DrawElementsIndirectCommand>& commands,
+                      const std::vector<GLuint>& transformSlots);
+
+        // Draws commands [first, first + count) of the last setDraws, all of meshes with indexType,
+        // from the position stream with depthOnly; returns the GL draw calls issued
+        size_t multiDraw(size_t first, size_t count, GLenum indexType, bool depthOnly = false);
+
+        bool indirect() const { return useIndirect; }
+
+    private:
+        std::vector<unsigned char> vertexData;
+        std::vector<unsigned char> positionData;
+        std::vector<GLuint> indexData;
+        std::vector<GLushort> shortIndexData;
+        size_t vertexSize = 0;
+
+        GLuint vao = 0;
+        GLuint vbo = 0;
+        GLuint depthVao = 0;
+        GLuint positionVbo = 0;
+        GLuint ebo = 0;
+        GLuint shortVao = 0;
+        GLuint shortDepthVao = 0;
+        GLuint shortEbo = 0;
+        GLuint indirectBuffer = 0;
+        GLuint transformBuffer = 0;
+        bool useIndirect = false;
+
+        // the transform slot attribute, fed by transformBuffer, on the bound vertex array
+        void setTransformAttribute();
+        // the vertex array and depth vertex array reading indices from elementBuffer
+        void createVertexArrays(GLuint elementBuffer, GLuint& vertexArray, GLuint& depthVertexArray);
+
+        // kept for the fallback path
+        std::vector<DrawElementsIndirectCommand> commands;
+        std::vector<GLuint> transformSlots;
+    };
+
+    extern GeometryPool geometryPool;
+}
+
+#endif /* GeometryPool_hpp */
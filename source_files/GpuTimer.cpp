@@ -0,0 +1,56 @@
+#include "GpuTimer.hpp"
+
+namespace gps {
+
+    void GpuTimer::create()
+    {
+        glGenQueries(QUERY_COUNT, queries);
+    }
+
+    void GpuTimer::collect()
+    {
+        for (int i = 0; i < QUERY_COUNT; i++) {
+            if (!pending[i])
+                continue;
+            GLint available = 0;
+            glGetQueryObjectiv(queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                continue;
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+            totalMs += (double)elapsed / 1e6;
+            samples++;
+            pending[i] = false;
+        }
+    }
+
+    void GpuTimer::begin()
+    {
+        collect();
+        running = !pending[next];
+        if (running)
+            glBeginQuery(GL_TIME_ELAPSED, queries[next]);
+    }
+
+    void GpuTimer::end()
+    {
+        if (!running)
+            return;
+        glEndQuery(GL_TIME_ELAPSED);
+        pending[next] = true;
+        next = (next + 1) % QUERY_COUNT;
+        running = false;
+    }
+
+    double GpuTimer::averageMs()
+    {
+        collect();
+        return samples ? totalMs / (double)samples : 0.0;
+    }
+
+    void GpuTimer::reset()
+    {
+        totalMs = 0.0;
+        samples = 0;
+    }
+}
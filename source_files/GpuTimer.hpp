@@ -0,0 +1,41 @@
+#ifndef GpuTimer_hpp
+#define GpuTimer_hpp
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+namespace gps {
+
+    // GPU time of a pass through GL_TIME_ELAPSED queries. Results are collected a few frames
+    // later, so the CPU never waits for them; a frame whose query is still in flight is not timed.
+    // Time queries do not nest, only one timer may be running at a time.
+    class GpuTimer
+    {
+    public:
+        static const int QUERY_COUNT = 4;
+
+        // Needs the GL context
+        void create();
+
+        void begin();
+        void end();
+
+        // Mean of the results collected since the last reset, in milliseconds
+        double averageMs();
+        void reset();
+
+    private:
+        GLuint queries[QUERY_COUNT];
+        bool pending[QUERY_COUNT] = {};
+        int next = 0;
+        bool running = false;
+        double totalMs = 0.0;
+        size_t samples = 0;
+
+        // reads the results that are ready
+        void collect();
+    };
+}
+
+#endif /* GpuTimer_hpp */
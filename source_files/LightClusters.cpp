@@ -0,0 +1,169 @@
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define CLUSTERS_SSE 1
+#endif
+
+namespace gps {
+
+    // buffer texture of the given format, its storage respecified by upload()
+    static void createBufferTexture(GLuint& buffer, GLuint& texture, GLenum format)
+    {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+
+        glGenTextures(1, &texture);
+        glBindTexture(GL_TEXTURE_BUFFER, texture);
+        glTexBuffer(GL_TEXTURE_BUFFER, format, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    // respecifying the storage lets the driver orphan the copy the last frame still reads
+    static void upload(GLuint buffer, const void* data, size_t size)
+    {
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        glBufferData(GL_TEXTURE_BUFFER, std::max(size, (size_t)16), size ? data : NULL, GL_STREAM_DRAW);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+    }
+
+    void LightClusters::create()
+    {
+        createBufferTexture(lightBuffer, lightTex, GL_RGBA32F);
+        createBufferTexture(rangeBuffer, rangeTex, GL_RG32UI);
+        createBufferTexture(indexBuffer, indexTex, GL_R32UI);
+    }
+
+    void LightClusters::transformLights(const glm::mat4& view, size_t count)
+    {
+        viewX.resize(count);
+        viewY.resize(count);
+        viewZ.resize(count);
+        size_t i = 0;
+
+#ifdef CLUSTERS_SSE
+        __m128 m[4][3];
+        for (int column = 0; column < 4; column++) {
+            for (int row = 0; row < 3; row++)
+                m[column][row] = _mm_set1_ps(view[column][row]);
+        }
+        for (; i + 4 <= count; i += 4) {
+            __m128 x = _mm_loadu_ps(&worldX[i]);
+            __m128 y = _mm_loadu_ps(&worldY[i]);
+            __m128 z = _mm_loadu_ps(&worldZ[i]);
+            float* out[3] = { &viewX[i], &viewY[i], &viewZ[i] };
+            for (int row = 0; row < 3; row++) {
+                __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, m[0][row]), _mm_mul_ps(y, m[1][row])),
+                                      _mm_add_ps(_mm_mul_ps(z, m[2][row]), m[3][row]));
+                _mm_storeu_ps(out[row], v);
+            }
+        }
+#endif
+
+        for (; i < count; i++) {
+            glm::vec4 v = view * glm::vec4(worldX[i], worldY[i], worldZ[i], 1.0f);
+            viewX[i] = v.x;
+            viewY[i] = v.y;
+            viewZ[i] = v.z;
+        }
+    }
+
+    LightClusters::ClusterBox LightClusters::clusterBox(size_t light, float radius, const glm::mat4& projection,
+                                                        float nearPlane, float farPlane) const
+    {
+        ClusterBox box = { 0, -1, 0, -1, 0, -1 };
+
+        // depth range of the sphere, in front of the camera
+        float depth = -viewZ[light];
+        float depthNear = std::max(depth - radius, nearPlane);
+        float depthFar = std::min(depth + radius, farPlane);
+        if (depthNear > depthFar)
+            return box;
+
+        // screen range of the box around the sphere, over that depth range
+        float centre[2] = { viewX[light], viewY[light] };
+        float focal[2] = { projection[0][0], projection[1][1] };
+        int tiles[2] = { CLUSTER_X, CLUSTER_Y };
+        int first[2], last[2];
+        for (int axis = 0; axis < 2; axis++) {
+            float low = centre[axis] - radius;
+            float high = centre[axis] + radius;
+            float ndcLow = focal[axis] * low / (low < 0.0f ? depthNear : depthFar);
+            float ndcHigh = focal[axis] * high / (high > 0.0f ? depthNear : depthFar);
+            if (ndcHigh < -1.0f || ndcLow > 1.0f)
+                return box;
+            first[axis] = std::max((int)std::floor((ndcLow * 0.5f + 0.5f) * tiles[axis]), 0);
+            last[axis] = std::min((int)std::floor((ndcHigh * 0.5f + 0.5f) * tiles[axis]), tiles[axis] - 1);
+        }
+
+        box.x0 = first[0];
+        box.x1 = last[0];
+        box.y0 = first[1];
+        box.y1 = last[1];
+        box.z0 = std::max((int)std::floor(std::log(depthNear) * scale + bias), 0);
+        box.z1 = std::min((int)std::floor(std::log(depthFar) * scale + bias), CLUSTER_Z - 1);
+        return box;
+    }
+
+    void LightClusters::build(const ClusterLight* lights, size_t count, const glm::mat4& view,
+                              const glm::mat4& projection, float nearPlane, float farPlane)
+    {
+        // slice k covers near * (far / near)^(k / CLUSTER_Z) onwards
+        scale = (float)CLUSTER_Z / std::log(farPlane / nearPlane);
+        bias = -std::log(nearPlane) * scale;
+
+        worldX.resize(count);
+        worldY.resize(count);
+        worldZ.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            worldX[i] = lights[i].position.x;
+            worldY[i] = lights[i].position.y;
+            worldZ[i] = lights[i].position.z;
+        }
+        transformLights(view, count);
+
+        lightTexels.resize(count * TEXELS_PER_LIGHT);
+        for (size_t i = 0; i < count; i++) {
+            lightTexels[i * TEXELS_PER_LIGHT] = glm::vec4(viewX[i], viewY[i], viewZ[i], lights[i].radius);
+            lightTexels[i * TEXELS_PER_LIGHT + 1] = glm::vec4(lights[i].color, 0.0f);
+        }
+
+        // counting sort: cluster sizes, their offsets, then the indices
+        ranges.assign(CLUSTER_COUNT * 2, 0);
+        boxes.resize(count);
+        for (size_t i = 0; i < count; i++) {
+            const ClusterBox& box = boxes[i] = clusterBox(i, lights[i].radius, projection, nearPlane, farPlane);
+            for (int z = box.z0; z <= box.z1; z++)
+                for (int y = box.y0; y <= box.y1; y++)
+                    for (int x = box.x0; x <= box.x1; x++)
+                        ranges[((z * CLUSTER_Y + y) * CLUSTER_X + x) * 2 + 1]++;
+        }
+
+        uint32_t offset = 0;
+        for (int cluster = 0; cluster < CLUSTER_COUNT; cluster++) {
+            ranges[cluster * 2] = offset;
+            offset += ranges[cluster * 2 + 1];
+            ranges[cluster * 2 + 1] = 0;
+        }
+
+        indices.resize(offset);
+        for (size_t i = 0; i < count; i++) {
+            const ClusterBox& box = boxes[i];
+            for (int z = box.z0; z <= box.z1; z++)
+                for (int y = box.y0; y <= box.y1; y++)
+                    for (int x = box.x0; x <= box.x1; x++) {
+                        uint32_t* range = &ranges[((z * CLUSTER_Y + y) * CLUSTER_X + x) * 2];
+                        indices[range[0] + range[1]++] = (uint32_t)i;
+                    }
+        }
+
+        upload(lightBuffer, lightTexels.data(), lightTexels.size() * sizeof(glm::vec4));
+        upload(rangeBuffer, ranges.data(), ranges.size() * sizeof(uint32_t));
+        upload(indexBuffer, indices.data(), indices.size() * sizeof(uint32_t));
+    }
+}
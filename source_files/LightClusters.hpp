@@ -0,0 +1,80 @@
+#ifndef LightClusters_hpp
+#define LightClusters_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Unshadowed point light with a finite reach
+    struct ClusterLight {
+        // world space
+        glm::vec3 position;
+        float radius;
+        glm::vec3 color;
+    };
+
+    // Clustered forward lighting: the camera frustum is cut into CLUSTER_X x CLUSTER_Y screen tiles
+    // and CLUSTER_Z exponential depth slices, and every cluster lists the lights whose sphere may
+    // reach it, so a fragment only loops over the lights of its own cluster.
+    // The lights, the cluster ranges and the index list live in buffer textures.
+    class LightClusters
+    {
+    public:
+        static const int CLUSTER_X = 16;
+        static const int CLUSTER_Y = 9;
+        static const int CLUSTER_Z = 24;
+        static const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+        // view space position and radius, then the colour
+        static const int TEXELS_PER_LIGHT = 2;
+
+        // Needs the GL context
+        void create();
+
+        // Moves the first count lights to view space, bins them into the clusters of the camera
+        // frustum and uploads the textures - once per frame
+        void build(const ClusterLight* lights, size_t count, const glm::mat4& view, const glm::mat4& projection,
+                   float nearPlane, float farPlane);
+
+        // Depth slice of an eye-space distance d: floor(log(d) * sliceScale + sliceBias)
+        float sliceScale() const { return scale; }
+        float sliceBias() const { return bias; }
+
+        GLuint lightTexture() const { return lightTex; }
+        // offset and count of each cluster's run in indexTexture()
+        GLuint rangeTexture() const { return rangeTex; }
+        GLuint indexTexture() const { return indexTex; }
+
+        // Light references stored in the last build
+        size_t indexCount() const { return indices.size(); }
+
+    private:
+        GLuint lightBuffer = 0, lightTex = 0;
+        GLuint rangeBuffer = 0, rangeTex = 0;
+        GLuint indexBuffer = 0, indexTex = 0;
+        float scale = 0.0f;
+        float bias = 0.0f;
+
+        // world and view space positions, structure of arrays for the SSE transform
+        std::vector<float> worldX, worldY, worldZ;
+        std::vector<float> viewX, viewY, viewZ;
+        std::vector<glm::vec4> lightTexels;
+        // cluster range of each light: x, y, z first and last, empty when x0 > x1
+        struct ClusterBox {
+            int x0, x1, y0, y1, z0, z1;
+        };
+        std::vector<ClusterBox> boxes;
+        // offset and count per cluster
+        std::vector<uint32_t> ranges;
+        std::vector<uint32_t> indices;
+
+        void transformLights(const glm::mat4& view, size_t count);
+        ClusterBox clusterBox(size_t light, float radius, const glm::mat4& projection, float nearPlane, float farPlane) const;
+    };
+}
+
+#endif /* LightClusters_hpp */
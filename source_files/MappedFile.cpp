@@ -0,0 +1,129 @@
+#include "MappedFile.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace gps {
+
+#ifdef _WIN32
+    MappedFile::MappedFile() : mappedData(nullptr), mappedSize(0), fileHandle(INVALID_HANDLE_VALUE), mappingHandle(nullptr)
+    {
+    }
+#else
+    MappedFile::MappedFile() : mappedData(nullptr), mappedSize(0), fileDescriptor(-1)
+    {
+    }
+#endif
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::open(const std::string& fileName)
+    {
+        close();
+
+#ifdef _WIN32
+        fileHandle = CreateFileA(fileName.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+            FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (fileHandle == INVALID_HANDLE_VALUE)
+            return false;
+
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(fileHandle, &fileSize)) {
+            close();
+            return false;
+        }
+        mappedSize = (size_t)fileSize.QuadPart;
+
+        // an empty file cannot be mapped, but it is still a valid (empty) file
+        if (mappedSize == 0)
+            return true;
+
+        mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (mappingHandle == NULL) {
+            close();
+            return false;
+        }
+
+        mappedData = (const char*)MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+        if (mappedData == NULL) {
+            close();
+            return false;
+        }
+#else
+        fileDescriptor = ::open(fileName.c_str(), O_RDONLY);
+        if (fileDescriptor < 0)
+            return false;
+
+        struct stat fileStat;
+        if (fstat(fileDescriptor, &fileStat) != 0) {
+            close();
+            return false;
+        }
+        mappedSize = (size_t)fileStat.st_size;
+
+        if (mappedSize == 0)
+            return true;
+
+        void* mapping = mmap(NULL, mappedSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+        if (mapping == MAP_FAILED) {
+            close();
+            return false;
+        }
+        madvise(mapping, mappedSize, MADV_SEQUENTIAL);
+        mappedData = (const char*)mapping;
+#endif
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+#ifdef _WIN32
+        if (mappedData)
+            UnmapViewOfFile(mappedData);
+        if (mappingHandle)
+            CloseHandle(mappingHandle);
+        if (fileHandle != INVALID_HANDLE_VALUE)
+            CloseHandle(fileHandle);
+        mappingHandle = nullptr;
+        fileHandle = INVALID_HANDLE_VALUE;
+#else
+        if (mappedData)
+            munmap((void*)mappedData, mappedSize);
+        if (fileDescriptor >= 0)
+            ::close(fileDescriptor);
+        fileDescriptor = -1;
+#endif
+        mappedData = nullptr;
+        mappedSize = 0;
+    }
+
+    const char* MappedFile::data() const
+    {
+        return mappedData;
+    }
+
+    size_t MappedFile::size() const
+    {
+        return mappedSize;
+    }
+
+    bool MappedFile::isOpen() const
+    {
+#ifdef _WIN32
+        return fileHandle != INVALID_HANDLE_VALUE;
+#else
+        return fileDescriptor >= 0;
+#endif
+    }
+}
@@ -0,0 +1,39 @@
+#ifndef MappedFile_hpp
+#define MappedFile_hpp
+
+#include <cstddef>
+#include <string>
+
+namespace gps {
+
+    // Read-only memory mapping of a whole file
+    class MappedFile
+    {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        // Maps the file into memory, returns false if it cannot be opened
+        bool open(const std::string& fileName);
+        void close();
+
+        const char* data() const;
+        size_t size() const;
+        bool isOpen() const;
+
+    private:
+        const char* mappedData;
+        size_t mappedSize;
+#ifdef _WIN32
+        void* fileHandle;
+        void* mappingHandle;
+#else
+        int fileDescriptor;
+#endif
+
+        MappedFile(const MappedFile&) = delete;
+        MappedFile& operator=(const MappedFile&) = delete;
+    };
+}
+
+#endif /* MappedFile_hpp */
@@ -1,59 +1,240 @@
 #include "Mesh.hpp"
+#include "GLStateCache.hpp"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstring>
+
 namespace gps {
 
-	/* Mesh Constructor */
+	bool Mesh::packedVertices = true;
+	bool Mesh::pooledGeometry = true;
+
+	// distinct diffuse/specular/ambient texture combinations, indexed by Mesh::textureSet
+	static std::vector<std::array<GLuint, 3>> textureSets;
+
+	// a coarser level must be this far under the pixel error before it replaces the current one
+	const float LOD_HYSTERESIS = 0.7f;
+
+	/* Mesh Constructor - only stores the data, setupMesh() uploads it */
 	Mesh::Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures)
 	{
-		this->vertices = vertices;
-		this->indices = indices;
-		this->textures = textures;
+		this->vertices = std::move(vertices);
+		this->indices = std::move(indices);
+		this->textures = std::move(textures);
+		this->material = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+		this->buffers = {};
+		this->dequantize = glm::mat4(1.0f);
+		this->indexType = GL_UNSIGNED_INT;
+		this->poolBaseVertex = 0;
+		this->poolFirstIndex = 0;
+
+		MeshLod fullMesh = { 0, (GLuint)this->indices.size(), 0.0f };
+		this->lods.push_back(fullMesh);
+		this->textureSet = 0;
 
-		this->setupMesh();
+		this->boundsMin = glm::vec3(0.0f);
+		this->boundsMax = glm::vec3(0.0f);
+		if (!this->vertices.empty()) {
+			this->boundsMin = this->boundsMax = this->vertices[0].Position;
+			for (size_t i = 1; i < this->vertices.size(); i++) {
+				this->boundsMin = glm::min(this->boundsMin, this->vertices[i].Position);
+				this->boundsMax = glm::max(this->boundsMax, this->vertices[i].Position);
+			}
+		}
+		this->boundsCenter = (this->boundsMin + this->boundsMax) * 0.5f;
+		this->boundsRadius = 0.0f;
+		for (size_t i = 0; i < this->vertices.size(); i++)
+			this->boundsRadius = std::max(this->boundsRadius, glm::length(this->vertices[i].Position - this->boundsCenter));
 	}
 
 	Buffers Mesh::getBuffers() {
 	    return this->buffers;
 	}
 
+	GLuint Mesh::vertexArray() const {
+		return pooledGeometry ? geometryPool.vertexArray(this->indexType) : this->buffers.VAO;
+	}
+
+	GLuint Mesh::depthVertexArray() const {
+		return pooledGeometry ? geometryPool.depthVertexArray(this->indexType) : this->buffers.depthVAO;
+	}
+
+	void Mesh::bindTextures() const {
+		//the samplers already point at their fixed units,
+		//units this mesh has no texture for are left empty
+		glState.bindTexture(TEXTURE_UNIT_DIFFUSE, GL_TEXTURE_2D, this->unitTextures[TEXTURE_UNIT_DIFFUSE]);
+		glState.bindTexture(TEXTURE_UNIT_SPECULAR, GL_TEXTURE_2D, this->unitTextures[TEXTURE_UNIT_SPECULAR]);
+		glState.bindTexture(TEXTURE_UNIT_AMBIENT, GL_TEXTURE_2D, this->unitTextures[TEXTURE_UNIT_AMBIENT]);
+	}
+
+	DrawElementsIndirectCommand Mesh::indirectCommand(const MeshLod& level, GLuint instances, GLuint baseInstance) const {
+		DrawElementsIndirectCommand command = { level.indexCount, instances, this->poolFirstIndex + level.firstIndex,
+			this->poolBaseVertex, baseInstance };
+		return command;
+	}
+
 	/* Mesh drawing function - also applies associated textures */
-	void Mesh::Draw(gps::Shader shader)
+	void Mesh::Draw(gps::Shader& shader, const MeshLod& level, GLuint instances)
 	{
 		shader.useShaderProgram();
+		bindTextures();
 
-		//set textures
-		for (GLuint i = 0; i < textures.size(); i++)
-		{
-			glActiveTexture(GL_TEXTURE0 + i);
-			glUniform1i(glGetUniformLocation(shader.shaderProgram, this->textures[i].type.c_str()), i);
-			glBindTexture(GL_TEXTURE_2D, this->textures[i].id);
+		glState.bindVertexArray(vertexArray());
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		if (pooledGeometry) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, this->indexType,
+				(GLvoid*)((this->poolFirstIndex + level.firstIndex) * indexSize), instances, this->poolBaseVertex);
+			return;
 		}
+		glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, this->indexType, (GLvoid*)(level.firstIndex * indexSize), instances);
+	}
 
-		glBindVertexArray(this->buffers.VAO);
-		glDrawElements(GL_TRIANGLES, this->indices.size(), GL_UNSIGNED_INT, 0);
-		glBindVertexArray(0);
+	void Mesh::DrawDepth(const MeshLod& level, GLuint instances)
+	{
+		glState.bindVertexArray(depthVertexArray());
+		size_t indexSize = this->indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+		if (pooledGeometry) {
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, level.indexCount, this->indexType,
+				(GLvoid*)((this->poolFirstIndex + level.firstIndex) * indexSize), instances, this->poolBaseVertex);
+			return;
+		}
+		glDrawElementsInstanced(GL_TRIANGLES, level.indexCount, this->indexType, (GLvoid*)(level.firstIndex * indexSize), instances);
+	}
+
+	int Mesh::selectLod(int current, float pixelsPerUnit, float pixelError) const {
+		int last = (int)this->lods.size() - 1;
+		int lod = std::min(std::max(current, 0), last);
+
+		if (this->lods[lod].error * pixelsPerUnit > pixelError) {
+			// too coarse - refine right away
+			while (lod > 0 && this->lods[lod].error * pixelsPerUnit > pixelError)
+				lod--;
+		}
+		else {
+			while (lod < last && this->lods[lod + 1].error * pixelsPerUnit <= pixelError * LOD_HYSTERESIS)
+				lod++;
+		}
+		return lod;
+	}
 
-        for(GLuint i = 0; i < this->textures.size(); i++)
-        {
-            glActiveTexture(GL_TEXTURE0 + i);
-            glBindTexture(GL_TEXTURE_2D, 0);
-        }
+	// position streams of the depth pass, in the same vertex order as the full layout
+	static std::vector<glm::vec3> floatPositions(const std::vector<Vertex>& vertices) {
+		std::vector<glm::vec3> positions(vertices.size());
+		for (size_t i = 0; i < vertices.size(); i++)
+			positions[i] = vertices[i].Position;
+		return positions;
+	}
 
-    }
+	static std::vector<PackedPosition> packedPositions(const std::vector<PackedVertex>& packed) {
+		std::vector<PackedPosition> positions(packed.size());
+		for (size_t i = 0; i < packed.size(); i++)
+			memcpy(positions[i].Position, packed[i].Position, sizeof(positions[i].Position));
+		return positions;
+	}
 
 	// Initializes all the buffer objects/arrays
 	void Mesh::setupMesh(){
+		this->unitTextures[0] = this->unitTextures[1] = this->unitTextures[2] = 0;
+		for (size_t i = 0; i < this->textures.size(); i++) {
+			if (this->textures[i].type == "specularTexture")
+				this->textures[i].unit = TEXTURE_UNIT_SPECULAR;
+			else if (this->textures[i].type == "ambientTexture")
+				this->textures[i].unit = TEXTURE_UNIT_AMBIENT;
+			else
+				this->textures[i].unit = TEXTURE_UNIT_DIFFUSE;
+			this->unitTextures[this->textures[i].unit] = this->textures[i].id;
+		}
+
+		std::array<GLuint, 3> textureSet = { this->unitTextures[0], this->unitTextures[1], this->unitTextures[2] };
+		auto found = std::find(textureSets.begin(), textureSets.end(), textureSet);
+		this->textureSet = (uint32_t)(found - textureSets.begin());
+		if (found == textureSets.end())
+			textureSets.push_back(textureSet);
+
+		if (pooledGeometry) {
+			// the pool creates the GL objects once every mesh is added; packed meshes take
+			// 16-bit indices when they fit, as with their own buffers
+			this->indexType = packedVertices && this->vertices.size() <= 65536 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+			if (packedVertices) {
+				std::vector<PackedVertex> packed = packVertices();
+				std::vector<PackedPosition> positions = packedPositions(packed);
+				geometryPool.add(packed.data(), positions.data(), packed.size(), sizeof(PackedVertex), sizeof(PackedPosition),
+					this->indices, this->indexType, this->poolBaseVertex, this->poolFirstIndex);
+			}
+			else {
+				this->dequantize = glm::mat4(1.0f);
+				std::vector<glm::vec3> positions = floatPositions(this->vertices);
+				geometryPool.add(this->vertices.data(), positions.data(), this->vertices.size(), sizeof(Vertex), sizeof(glm::vec3),
+					this->indices, this->indexType, this->poolBaseVertex, this->poolFirstIndex);
+			}
+			return;
+		}
+
 		// Create buffers/arrays
 		glGenVertexArrays(1, &this->buffers.VAO);
 		glGenBuffers(1, &this->buffers.VBO);
 		glGenBuffers(1, &this->buffers.EBO);
 
-		glBindVertexArray(this->buffers.VAO);
-		// Load data into vertex buffers
+		glState.bindVertexArray(this->buffers.VAO);
 		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.VBO);
-		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), &this->vertices[0], GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
+
+		if (packedVertices)
+			uploadPackedVertices();
+		else
+			uploadFloatVertices();
+
+		glState.bindVertexArray(0);
+	}
+
+	void Mesh::uploadFloatVertices() {
+		// Load data into vertex buffers
+		glBufferData(GL_ARRAY_BUFFER, this->vertices.size() * sizeof(Vertex), this->vertices.data(), GL_STATIC_DRAW);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), this->indices.data(), GL_STATIC_DRAW);
+		this->indexType = GL_UNSIGNED_INT;
+		this->dequantize = glm::mat4(1.0f);
+
+		setVertexAttributes(false);
+
+		std::vector<glm::vec3> positions = floatPositions(this->vertices);
+		uploadPositions(positions.data(), positions.size() * sizeof(glm::vec3), false);
+	}
+
+	void Mesh::uploadPositions(const void* positions, size_t size, bool packed) {
+		glGenVertexArrays(1, &this->buffers.depthVAO);
+		glGenBuffers(1, &this->buffers.positionVBO);
 
+		glState.bindVertexArray(this->buffers.depthVAO);
+		glBindBuffer(GL_ARRAY_BUFFER, this->buffers.positionVBO);
+		glBufferData(GL_ARRAY_BUFFER, size, positions, GL_STATIC_DRAW);
 		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, this->buffers.EBO);
-		glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), &this->indices[0], GL_STATIC_DRAW);
+		setPositionAttribute(packed);
+	}
+
+	void Mesh::setPositionAttribute(bool packed) {
+		glEnableVertexAttribArray(0);
+		if (packed)
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedPosition), (GLvoid*)0);
+		else
+			glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), (GLvoid*)0);
+	}
+
+	void Mesh::setVertexAttributes(bool packed) {
+		if (packed) {
+			// the shaders keep their vec3/vec3/vec2 inputs, missing components default to 0
+			glEnableVertexAttribArray(0);
+			glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Position));
+			glEnableVertexAttribArray(1);
+			glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, Normal));
+			glEnableVertexAttribArray(2);
+			glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (GLvoid*)offsetof(PackedVertex, TexCoords));
+			return;
+		}
 
 		// Set the vertex attribute pointers
 		// Vertex Positions
@@ -65,7 +246,66 @@ namespace gps {
 		// Vertex Texture Coords
 		glEnableVertexAttribArray(2);
 		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (GLvoid*)offsetof(Vertex, TexCoords));
+	}
+
+	// Octahedral mapping of a unit vector to [-1, 1]^2, decoded in basic.vert
+	static glm::vec2 octahedralEncode(glm::vec3 n) {
+		float sum = std::fabs(n.x) + std::fabs(n.y) + std::fabs(n.z);
+		if (sum == 0.0f)
+			return glm::vec2(0.0f);
+		n /= sum;
+		glm::vec2 e(n.x, n.y);
+		if (n.z < 0.0f) {
+			e.x = (1.0f - std::fabs(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+			e.y = (1.0f - std::fabs(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+		}
+		return e;
+	}
+
+	static GLshort packSnorm16(float v) {
+		return (GLshort)std::lround(std::min(std::max(v, -1.0f), 1.0f) * 32767.0f);
+	}
+
+	std::vector<PackedVertex> Mesh::packVertices() {
+		// flat meshes still need an invertible scale
+		glm::vec3 extent = glm::max(this->boundsMax - this->boundsMin, glm::vec3(1e-6f));
+
+		std::vector<PackedVertex> packed(this->vertices.size());
+		for (size_t i = 0; i < this->vertices.size(); i++) {
+			const Vertex& vertex = this->vertices[i];
+			glm::vec3 position = (vertex.Position - this->boundsMin) / extent;
+			glm::vec2 normal = octahedralEncode(vertex.Normal);
+			for (int k = 0; k < 3; k++)
+				packed[i].Position[k] = (GLushort)std::lround(std::min(std::max(position[k], 0.0f), 1.0f) * 65535.0f);
+			packed[i].Position[3] = 0;
+			packed[i].Normal[0] = packSnorm16(normal.x);
+			packed[i].Normal[1] = packSnorm16(normal.y);
+			packed[i].TexCoords[0] = glm::packHalf1x16(vertex.TexCoords.x);
+			packed[i].TexCoords[1] = glm::packHalf1x16(vertex.TexCoords.y);
+		}
+
+		// normalized positions come back in [0, 1]
+		this->dequantize = glm::scale(glm::translate(glm::mat4(1.0f), this->boundsMin), extent);
+		return packed;
+	}
+
+	void Mesh::uploadPackedVertices() {
+		std::vector<PackedVertex> packed = packVertices();
+		glBufferData(GL_ARRAY_BUFFER, packed.size() * sizeof(PackedVertex), packed.data(), GL_STATIC_DRAW);
+
+		if (this->vertices.size() <= 65536) {
+			std::vector<GLushort> shortIndices(this->indices.begin(), this->indices.end());
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, shortIndices.size() * sizeof(GLushort), shortIndices.data(), GL_STATIC_DRAW);
+			this->indexType = GL_UNSIGNED_SHORT;
+		}
+		else {
+			glBufferData(GL_ELEMENT_ARRAY_BUFFER, this->indices.size() * sizeof(GLuint), this->indices.data(), GL_STATIC_DRAW);
+			this->indexType = GL_UNSIGNED_INT;
+		}
+
+		setVertexAttributes(true);
 
-		glBindVertexArray(0);
+		std::vector<PackedPosition> positions = packedPositions(packed);
+		uploadPositions(positions.data(), positions.size() * sizeof(PackedPosition), true);
 	}
 }
@@ -5,7 +5,9 @@
 #include "glm/glm.hpp"
 
 #include "Shader.hpp"
+#include "GeometryPool.hpp"
 
+#include <cstdint>
 #include <string>
 #include <vector>
 
@@ -19,12 +21,30 @@ struct Vertex
     glm::vec2 TexCoords;
 };
 
+// Compressed layout uploaded when Mesh::packedVertices is set (16 instead of 32 bytes):
+// position quantized to the mesh bounds, octahedral normal, half float uvs
+struct PackedVertex
+{
+    GLushort Position[4];
+    GLshort Normal[2];
+    GLushort TexCoords[2];
+};
+
+// Position-only stream of the depth pass for the packed layout (8 instead of 16 bytes,
+// the float layout streams a bare glm::vec3)
+struct PackedPosition
+{
+    GLushort Position[4];
+};
+
 struct Texture
 {
     GLuint id;
     //ambientTexture, diffuseTexture, specularTexture
     std::string type;
     std::string path;
+    // texture unit of the type's sampler, set by Mesh::setupMesh
+    GLuint unit;
 };
 
 struct Material
@@ -34,10 +54,21 @@ struct Material
         glm::vec3 specular;
     };
 
+// Range of Mesh::indices drawn for one level of detail
+struct MeshLod {
+    GLuint firstIndex;
+    GLuint indexCount;
+    // largest surface deviation from the full mesh, in model units
+    float error;
+};
+
 struct Buffers {
     GLuint VAO;
     GLuint VBO;
     GLuint EBO;
+    // depth pass: positions only, sharing EBO
+    GLuint depthVAO;
+    GLuint positionVBO;
 };
 
 class Mesh
@@ -46,19 +77,85 @@ public:
     std::vector<Vertex> vertices;
     std::vector<GLuint> indices;
     std::vector<Texture> textures;
+    Material material;
+    // lods[0] is the full mesh, the others share its vertices
+    std::vector<MeshLod> lods;
+
+    // Index of the mesh's diffuse/specular/ambient texture combination, shared by
+    // all meshes using the same textures - set by setupMesh
+    uint32_t textureSet;
+
+    // Bounding box and sphere in model space
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    glm::vec3 boundsCenter;
+    float boundsRadius;
 
 	Mesh(std::vector<Vertex> vertices, std::vector<GLuint> indices, std::vector<Texture> textures);
 
 	Buffers getBuffers();
 
-	void Draw(gps::Shader shader);
+	// Own vertex array, or the shared one for pooled geometry
+	GLuint vertexArray() const;
+
+	// Vertex array fetching only the positions, for the depth pass
+	GLuint depthVertexArray() const;
+
+	// GL_UNSIGNED_SHORT or GL_UNSIGNED_INT, set by setupMesh
+	GLenum getIndexType() const { return indexType; }
+
+	// Draws one level of detail - the transform slot comes from the
+	// GeometryPool::TRANSFORM_ATTRIBUTE value set by the caller, plus gl_InstanceID
+	void Draw(gps::Shader& shader, const MeshLod& level, GLuint instances = 1);
+
+	// Depth-only Draw: position stream, no textures - the depth program must be bound
+	void DrawDepth(const MeshLod& level, GLuint instances = 1);
+
+	// Binds the diffuse/specular/ambient textures to their units
+	void bindTextures() const;
+
+	// Indirect command for one level of detail in the GeometryPool
+	DrawElementsIndirectCommand indirectCommand(const MeshLod& level, GLuint instances, GLuint baseInstance) const;
+
+	// Level to draw after current: the coarsest one whose error stays under pixelError pixels,
+	// switching to a coarser one only with some margin to avoid popping
+	int selectLod(int current, float pixelsPerUnit, float pixelError) const;
+
+	// Initializes all the buffer objects/arrays - needs the GL context
+	void setupMesh();
+
+	// Maps the uploaded positions back to model space - fold it into the model matrix
+	// (identity for the float layout)
+	glm::mat4 dequantize;
+
+	// Upload PackedVertex data and 16-bit indices (when possible) instead of the float layout
+	static bool packedVertices;
+
+	// Append the geometry to the shared GeometryPool (32-bit indices) instead of own buffers
+	static bool pooledGeometry;
+
+	// Attribute pointers of the Vertex or PackedVertex layout for the bound vertex array and buffer
+	static void setVertexAttributes(bool packed);
+
+	// Position attribute of the glm::vec3 or PackedPosition stream for the bound vertex array and buffer
+	static void setPositionAttribute(bool packed);
 
 private:
     /*  Render data  */
     Buffers buffers;
-
-	// Initializes all the buffer objects/arrays
-	void setupMesh();
+    GLenum indexType;
+    // where the mesh starts in the GeometryPool
+    GLint poolBaseVertex;
+    GLuint poolFirstIndex;
+    // texture bound to each of the diffuse/specular/ambient units (0 if the mesh has none)
+    GLuint unitTextures[3];
+
+    void uploadFloatVertices();
+    void uploadPackedVertices();
+    // Creates the depth vertex array over its own position buffer and the mesh's EBO
+    void uploadPositions(const void* positions, size_t size, bool packed);
+    // Quantizes the vertices and sets the dequantize matrix
+    std::vector<PackedVertex> packVertices();
 
 };
 
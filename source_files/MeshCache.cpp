@@ -0,0 +1,299 @@
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace gps {
+
+    // Cache file layout:
+    //   MeshCacheHeader, basePath characters
+    //   for each .mtl file: MeshCacheSource, path characters
+    //   for each mesh: MeshCacheEntry, vertices, indices (all levels of detail), lods,
+    //                  for each texture: type length, path length, type characters, path characters
+    struct MeshCacheHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t vertexSize;
+        uint32_t meshCount;
+        uint64_t sourceSize;
+        int64_t sourceTime;
+        uint64_t sourceHash;
+        uint32_t basePathLength;
+        // MESH_CACHE_* options the meshes were built with
+        uint32_t options;
+        uint32_t materialFileCount;
+        uint32_t reserved;
+    };
+
+    // A .mtl file the source read, checked like the source itself
+    struct MeshCacheSource {
+        uint64_t size;
+        int64_t time;
+        uint64_t hash;
+        uint32_t pathLength;
+        uint32_t reserved;
+    };
+
+    struct MeshCacheEntry {
+        uint32_t vertexCount;
+        uint32_t indexCount;
+        uint32_t textureCount;
+        uint32_t lodCount;
+        float ambient[3];
+        float diffuse[3];
+        float specular[3];
+    };
+
+    static const char MESH_CACHE_MAGIC[4] = { 'G', 'P', 'S', 'M' };
+
+    // size of a .mtl file that did not exist, the cache stays valid until it appears
+    static const uint64_t MISSING_FILE = ~0ull;
+
+    // FNV-1a over the whole source file
+    static uint64_t hashBytes(const char* data, size_t size)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < size; i++) {
+            hash ^= (unsigned char)data[i];
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    static bool hashFile(const std::string& fileName, uint64_t& hash)
+    {
+        MappedFile source;
+        if (!source.open(fileName))
+            return false;
+        hash = hashBytes(source.data(), source.size());
+        return true;
+    }
+
+    static bool statFile(const std::string& fileName, uint64_t& size, int64_t& time)
+    {
+        std::error_code error;
+        size = (uint64_t)std::filesystem::file_size(fileName, error);
+        if (error)
+            return false;
+        time = (int64_t)std::filesystem::last_write_time(fileName, error).time_since_epoch().count();
+        return !error;
+    }
+
+    // Size and time decide quickly, the hash rescues files that were only touched - their new
+    // time is written to time and touched is set, so the caller can store it
+    static bool checkSource(const std::string& fileName, uint64_t size, int64_t& time, uint64_t hash, bool& touched)
+    {
+        uint64_t currentSize;
+        int64_t currentTime;
+        if (!statFile(fileName, currentSize, currentTime))
+            return size == MISSING_FILE;
+        if (currentSize != size)
+            return false;
+        if (currentTime != time) {
+            uint64_t currentHash;
+            if (!hashFile(fileName, currentHash) || currentHash != hash)
+                return false;
+            time = currentTime;
+            touched = true;
+        }
+        return true;
+    }
+
+    // Everything before the meshes: header, base path and the .mtl file records
+    static void writeSources(std::ostream& out, const MeshCacheHeader& header, const std::string& basePath,
+                             const std::vector<MeshCacheSource>& materials, const std::vector<std::string>& materialFiles)
+    {
+        out.write((const char*)&header, sizeof(header));
+        out.write(basePath.data(), basePath.size());
+        for (size_t i = 0; i < materials.size(); i++) {
+            out.write((const char*)&materials[i], sizeof(MeshCacheSource));
+            out.write(materialFiles[i].data(), materialFiles[i].size());
+        }
+    }
+
+    // Bounds-checked reader over the mapped cache file
+    struct CacheReader {
+        const char* current;
+        const char* end;
+
+        bool read(void* destination, size_t size) {
+            if (size == 0)
+                return true;
+            if ((size_t)(end - current) < size)
+                return false;
+            memcpy(destination, current, size);
+            current += size;
+            return true;
+        }
+    };
+
+    bool ReadMeshCache(const std::string& cacheFile, const std::string& sourceFile, const std::string& basePath,
+                       uint32_t options, std::vector<gps::Mesh>& meshes)
+    {
+        MappedFile cache;
+        if (!cache.open(cacheFile))
+            return false;
+
+        CacheReader reader = { cache.data(), cache.data() + cache.size() };
+
+        MeshCacheHeader header;
+        if (!reader.read(&header, sizeof(header)))
+            return false;
+        if (memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+            header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(gps::Vertex) || header.options != options)
+            return false;
+
+        std::string cachedBasePath(header.basePathLength, '\0');
+        if (!reader.read(&cachedBasePath[0], header.basePathLength) || cachedBasePath != basePath)
+            return false;
+
+        bool touched = false;
+        if (!checkSource(sourceFile, header.sourceSize, header.sourceTime, header.sourceHash, touched))
+            return false;
+
+        // materials and texture paths come from the .mtl files
+        std::vector<MeshCacheSource> materials(header.materialFileCount);
+        std::vector<std::string> materialFiles(header.materialFileCount);
+        for (uint32_t i = 0; i < header.materialFileCount; i++) {
+            if (!reader.read(&materials[i], sizeof(MeshCacheSource)))
+                return false;
+            materialFiles[i].resize(materials[i].pathLength);
+            if (!reader.read(&materialFiles[i][0], materials[i].pathLength) ||
+                !checkSource(materialFiles[i], materials[i].size, materials[i].time, materials[i].hash, touched))
+                return false;
+        }
+
+        std::vector<gps::Mesh> cachedMeshes;
+        cachedMeshes.reserve(header.meshCount);
+
+        for (uint32_t m = 0; m < header.meshCount; m++) {
+            MeshCacheEntry entry;
+            if (!reader.read(&entry, sizeof(entry)))
+                return false;
+
+            std::vector<gps::Vertex> vertices(entry.vertexCount);
+            std::vector<GLuint> indices(entry.indexCount);
+            std::vector<gps::Texture> textures(entry.textureCount);
+            std::vector<gps::MeshLod> lods(entry.lodCount);
+
+            if (!reader.read(vertices.data(), vertices.size() * sizeof(gps::Vertex)) ||
+                !reader.read(indices.data(), indices.size() * sizeof(GLuint)) ||
+                !reader.read(lods.data(), lods.size() * sizeof(gps::MeshLod)))
+                return false;
+
+            if (lods.empty())
+                return false;
+            for (size_t l = 0; l < lods.size(); l++) {
+                if ((uint64_t)lods[l].firstIndex + lods[l].indexCount > indices.size())
+                    return false;
+            }
+
+            for (uint32_t t = 0; t < entry.textureCount; t++) {
+                uint32_t lengths[2];
+                if (!reader.read(lengths, sizeof(lengths)))
+                    return false;
+
+                textures[t].id = 0;
+                textures[t].type.resize(lengths[0]);
+                textures[t].path.resize(lengths[1]);
+                if (!reader.read(&textures[t].type[0], lengths[0]) || !reader.read(&textures[t].path[0], lengths[1]))
+                    return false;
+            }
+
+            gps::Mesh mesh(std::move(vertices), std::move(indices), std::move(textures));
+            mesh.material.ambient = glm::vec3(entry.ambient[0], entry.ambient[1], entry.ambient[2]);
+            mesh.material.diffuse = glm::vec3(entry.diffuse[0], entry.diffuse[1], entry.diffuse[2]);
+            mesh.material.specular = glm::vec3(entry.specular[0], entry.specular[1], entry.specular[2]);
+            mesh.lods = std::move(lods);
+            cachedMeshes.push_back(std::move(mesh));
+        }
+
+        meshes = std::move(cachedMeshes);
+
+        // store the new times, or every later launch hashes the touched files again
+        if (touched) {
+            cache.close();
+            std::fstream out(cacheFile, std::ios::binary | std::ios::in | std::ios::out);
+            if (out)
+                writeSources(out, header, basePath, materials, materialFiles);
+        }
+        return true;
+    }
+
+    bool WriteMeshCache(const std::string& cacheFile, const std::string& sourceFile,
+                        const std::vector<std::string>& materialFiles, const std::string& basePath,
+                        uint32_t options, const std::vector<gps::Mesh>& meshes)
+    {
+        MeshCacheHeader header = {};
+        memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(header.magic));
+        header.version = MESH_CACHE_VERSION;
+        header.vertexSize = sizeof(gps::Vertex);
+        header.meshCount = (uint32_t)meshes.size();
+        header.basePathLength = (uint32_t)basePath.size();
+        header.options = options;
+        header.materialFileCount = (uint32_t)materialFiles.size();
+        if (!statFile(sourceFile, header.sourceSize, header.sourceTime) || !hashFile(sourceFile, header.sourceHash))
+            return false;
+
+        std::vector<MeshCacheSource> materials(materialFiles.size());
+        for (size_t i = 0; i < materialFiles.size(); i++) {
+            MeshCacheSource& material = materials[i];
+            material.pathLength = (uint32_t)materialFiles[i].size();
+            if (!statFile(materialFiles[i], material.size, material.time) || !hashFile(materialFiles[i], material.hash)) {
+                material.size = MISSING_FILE;
+                material.time = 0;
+                material.hash = 0;
+            }
+        }
+
+        // write next to the final name and rename, so a crash never leaves half a cache behind
+        std::string temporaryFile = cacheFile + ".tmp";
+        {
+            std::ofstream out(temporaryFile, std::ios::binary | std::ios::trunc);
+            if (!out)
+                return false;
+
+            writeSources(out, header, basePath, materials, materialFiles);
+
+            for (size_t m = 0; m < meshes.size(); m++) {
+                const gps::Mesh& mesh = meshes[m];
+
+                MeshCacheEntry entry = {};
+                entry.vertexCount = (uint32_t)mesh.vertices.size();
+                entry.indexCount = (uint32_t)mesh.indices.size();
+                entry.textureCount = (uint32_t)mesh.textures.size();
+                entry.lodCount = (uint32_t)mesh.lods.size();
+                for (int i = 0; i < 3; i++) {
+                    entry.ambient[i] = mesh.material.ambient[i];
+                    entry.diffuse[i] = mesh.material.diffuse[i];
+                    entry.specular[i] = mesh.material.specular[i];
+                }
+
+                out.write((const char*)&entry, sizeof(entry));
+                out.write((const char*)mesh.vertices.data(), mesh.vertices.size() * sizeof(gps::Vertex));
+                out.write((const char*)mesh.indices.data(), mesh.indices.size() * sizeof(GLuint));
+                out.write((const char*)mesh.lods.data(), mesh.lods.size() * sizeof(gps::MeshLod));
+
+                for (size_t t = 0; t < mesh.textures.size(); t++) {
+                    uint32_t lengths[2] = { (uint32_t)mesh.textures[t].type.size(), (uint32_t)mesh.textures[t].path.size() };
+                    out.write((const char*)lengths, sizeof(lengths));
+                    out.write(mesh.textures[t].type.data(), lengths[0]);
+                    out.write(mesh.textures[t].path.data(), lengths[1]);
+                }
+            }
+
+            if (!out)
+                return false;
+        }
+
+        std::error_code error;
+        std::filesystem::rename(temporaryFile, cacheFile, error);
+        if (error) {
+            std::filesystem::remove(temporaryFile, error);
+            return false;
+        }
+        return true;
+    }
+}
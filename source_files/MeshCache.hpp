@@ -0,0 +1,32 @@
+#ifndef MeshCache_hpp
+#define MeshCache_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gps {
+
+    // Bump whenever the cached vertex/index data or the file layout changes
+    const uint32_t MESH_CACHE_VERSION = 5;
+
+    // Load options that change the cached data (MeshCacheHeader::options)
+    const uint32_t MESH_CACHE_OPTIMIZED = 1;
+    const uint32_t MESH_CACHE_LODS = 2;
+
+    // Reads the meshes stored in a cache file written for sourceFile with the same options.
+    // Fails if the cache is missing, has another version or options, or the source or one of
+    // its .mtl files changed.
+    bool ReadMeshCache(const std::string& cacheFile, const std::string& sourceFile, const std::string& basePath,
+                       uint32_t options, std::vector<gps::Mesh>& meshes);
+
+    // Writes the final vertex/index arrays, textures and materials of the meshes built from sourceFile
+    // and the materialFiles it read
+    bool WriteMeshCache(const std::string& cacheFile, const std::string& sourceFile,
+                        const std::vector<std::string>& materialFiles, const std::string& basePath,
+                        uint32_t options, const std::vector<gps::Mesh>& meshes);
+}
+
+#endif /* MeshCache_hpp */
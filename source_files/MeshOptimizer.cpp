@@ -0,0 +1,290 @@
+#include "MeshOptimizer.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace gps {
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize)
+    {
+        VertexCacheStats stats = { 0.0f, 0.0f };
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount == 0 || vertexCount == 0)
+            return stats;
+
+        // timestamp of the miss that put each vertex in the FIFO
+        std::vector<size_t> cachedAt(vertexCount, 0);
+        std::vector<bool> used(vertexCount, false);
+        size_t misses = 0;
+        size_t usedCount = 0;
+
+        for (size_t i = 0; i < triangleCount * 3; i++) {
+            GLuint v = indices[i];
+            if (!used[v]) {
+                used[v] = true;
+                usedCount++;
+            }
+            // a vertex is still cached if fewer than cacheSize misses happened since it was loaded
+            if (cachedAt[v] == 0 || misses + 1 - cachedAt[v] > cacheSize) {
+                misses++;
+                cachedAt[v] = misses;
+            }
+        }
+
+        stats.acmr = (float)misses / (float)triangleCount;
+        stats.atvr = (float)misses / (float)usedCount;
+        return stats;
+    }
+
+    // Forsyth scoring, see "Linear-Speed Vertex Cache Optimisation"
+    const int FORSYTH_CACHE_SIZE = 32;
+    const float FORSYTH_CACHE_DECAY_POWER = 1.5f;
+    const float FORSYTH_LAST_TRIANGLE_SCORE = 0.75f;
+    const float FORSYTH_VALENCE_BOOST_SCALE = 2.0f;
+    const float FORSYTH_VALENCE_BOOST_POWER = 0.5f;
+
+    static float vertexScore(int cachePosition, unsigned int liveTriangles)
+    {
+        if (liveTriangles == 0)
+            return -1.0f;
+
+        float score = 0.0f;
+        if (cachePosition >= 0) {
+            if (cachePosition < 3) {
+                // the last triangle's vertices get a fixed score so it is not reused immediately
+                score = FORSYTH_LAST_TRIANGLE_SCORE;
+            }
+            else {
+                float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+                score = std::pow(1.0f - (cachePosition - 3) * scaler, FORSYTH_CACHE_DECAY_POWER);
+            }
+        }
+
+        // favour vertices with few triangles left, so they do not end up as lone triangles
+        score += FORSYTH_VALENCE_BOOST_SCALE * std::pow((float)liveTriangles, -FORSYTH_VALENCE_BOOST_POWER);
+        return score;
+    }
+
+    void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        // vertex -> triangle adjacency, compacted as triangles get emitted
+        std::vector<unsigned int> liveTriangles(vertexCount, 0);
+        for (size_t i = 0; i < triangleCount * 3; i++)
+            liveTriangles[indices[i]]++;
+
+        std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            adjacencyOffset[v + 1] = adjacencyOffset[v] + liveTriangles[v];
+
+        std::vector<unsigned int> adjacency(triangleCount * 3);
+        {
+            std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+            for (size_t t = 0; t < triangleCount; t++)
+                for (int k = 0; k < 3; k++)
+                    adjacency[fill[indices[3 * t + k]]++] = (unsigned int)t;
+        }
+
+        std::vector<int> cachePosition(vertexCount, -1);
+        std::vector<float> vertexScores(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScores[v] = vertexScore(-1, liveTriangles[v]);
+
+        std::vector<float> triangleScores(triangleCount);
+        std::vector<bool> emitted(triangleCount, false);
+        for (size_t t = 0; t < triangleCount; t++)
+            triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] + vertexScores[indices[3 * t + 2]];
+
+        std::vector<GLuint> result;
+        result.reserve(triangleCount * 3);
+
+        // one extra slot per vertex of the emitted triangle, dropped off the end
+        GLuint cache[FORSYTH_CACHE_SIZE + 3];
+        int cacheCount = 0;
+        size_t nextCandidate = 0;
+
+        while (result.size() < triangleCount * 3) {
+            // best triangle touching the cache
+            long long best = -1;
+            float bestScore = -1.0f;
+            for (int c = 0; c < cacheCount; c++) {
+                GLuint v = cache[c];
+                for (size_t a = adjacencyOffset[v]; a < adjacencyOffset[v] + liveTriangles[v]; a++) {
+                    unsigned int t = adjacency[a];
+                    if (triangleScores[t] > bestScore) {
+                        bestScore = triangleScores[t];
+                        best = t;
+                    }
+                }
+            }
+
+            // nothing in the cache - restart from the next triangle in input order
+            if (best < 0) {
+                while (emitted[nextCandidate])
+                    nextCandidate++;
+                best = (long long)nextCandidate;
+            }
+
+            size_t t = (size_t)best;
+            emitted[t] = true;
+            triangleScores[t] = -1.0f;
+
+            GLuint corners[3] = { indices[3 * t], indices[3 * t + 1], indices[3 * t + 2] };
+            GLuint newCache[FORSYTH_CACHE_SIZE + 3];
+            int newCount = 0;
+
+            for (int k = 0; k < 3; k++) {
+                GLuint v = corners[k];
+                result.push_back(v);
+
+                // remove the triangle from the vertex's live list
+                size_t begin = adjacencyOffset[v];
+                size_t end = begin + liveTriangles[v];
+                for (size_t a = begin; a < end; a++) {
+                    if (adjacency[a] == t) {
+                        adjacency[a] = adjacency[end - 1];
+                        break;
+                    }
+                }
+                liveTriangles[v]--;
+
+                // degenerate triangles repeat vertices
+                if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+                    newCache[newCount++] = v;
+            }
+
+            // LRU: the triangle's vertices move to the front
+            for (int c = 0; c < cacheCount; c++) {
+                GLuint v = cache[c];
+                if (std::find(newCache, newCache + newCount, v) == newCache + newCount)
+                    newCache[newCount++] = v;
+            }
+
+            for (int c = 0; c < newCount; c++) {
+                GLuint v = newCache[c];
+                int position = c < FORSYTH_CACHE_SIZE ? c : -1;
+                cachePosition[v] = position;
+                float score = vertexScore(position, liveTriangles[v]);
+                float delta = score - vertexScores[v];
+                vertexScores[v] = score;
+                if (delta != 0.0f) {
+                    for (size_t a = adjacencyOffset[v]; a < adjacencyOffset[v] + liveTriangles[v]; a++)
+                        triangleScores[adjacency[a]] += delta;
+                }
+            }
+
+            cacheCount = std::min(newCount, FORSYTH_CACHE_SIZE);
+            std::copy(newCache, newCache + cacheCount, cache);
+        }
+
+        indices.swap(result);
+    }
+
+    struct TriangleCluster {
+        size_t begin;
+        size_t end;
+        float sortKey;
+    };
+
+    void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices, float threshold)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2 || vertices.empty())
+            return;
+
+        // split where the simulated cache restarts - a triangle with no cached vertex
+        // starts a new cluster, so moving whole clusters barely changes the ACMR
+        const unsigned int cacheSize = 16;
+        std::vector<size_t> cachedAt(vertices.size(), 0);
+        size_t misses = 0;
+        std::vector<TriangleCluster> clusters;
+
+        for (size_t t = 0; t < triangleCount; t++) {
+            int triangleMisses = 0;
+            for (int k = 0; k < 3; k++) {
+                GLuint v = indices[3 * t + k];
+                if (cachedAt[v] == 0 || misses + 1 - cachedAt[v] > cacheSize) {
+                    misses++;
+                    cachedAt[v] = misses;
+                    triangleMisses++;
+                }
+            }
+            if (t == 0 || triangleMisses == 3) {
+                TriangleCluster cluster = { t, t + 1, 0.0f };
+                clusters.push_back(cluster);
+            }
+            else {
+                clusters.back().end = t + 1;
+            }
+        }
+
+        if (clusters.size() < 2)
+            return;
+
+        glm::vec3 meshCentroid(0.0f);
+        for (size_t i = 0; i < vertices.size(); i++)
+            meshCentroid += vertices[i].Position;
+        meshCentroid /= (float)vertices.size();
+
+        // clusters facing away from the mesh centre are likely to occlude the others
+        for (size_t c = 0; c < clusters.size(); c++) {
+            glm::vec3 centroid(0.0f);
+            glm::vec3 normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c].begin; t < clusters[c].end; t++) {
+                const glm::vec3& p0 = vertices[indices[3 * t]].Position;
+                const glm::vec3& p1 = vertices[indices[3 * t + 1]].Position;
+                const glm::vec3& p2 = vertices[indices[3 * t + 2]].Position;
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float triangleArea = glm::length(n);
+                centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+                normal += n;
+                area += triangleArea;
+            }
+            if (area > 0.0f)
+                centroid /= area;
+            float normalLength = glm::length(normal);
+            if (normalLength > 0.0f)
+                normal /= normalLength;
+            clusters[c].sortKey = glm::dot(centroid - meshCentroid, normal);
+        }
+
+        std::stable_sort(clusters.begin(), clusters.end(), [](const TriangleCluster& a, const TriangleCluster& b) {
+            return a.sortKey > b.sortKey;
+        });
+
+        std::vector<GLuint> result;
+        result.reserve(indices.size());
+        for (size_t c = 0; c < clusters.size(); c++)
+            result.insert(result.end(), indices.begin() + 3 * clusters[c].begin, indices.begin() + 3 * clusters[c].end);
+        // keep any trailing indices that do not form a triangle
+        result.insert(result.end(), indices.begin() + 3 * triangleCount, indices.end());
+
+        float before = AnalyzeVertexCache(indices, vertices.size(), cacheSize).acmr;
+        float after = AnalyzeVertexCache(result, vertices.size(), cacheSize).acmr;
+        if (after <= before * threshold)
+            indices.swap(result);
+    }
+
+    void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices)
+    {
+        const GLuint unused = ~0u;
+        std::vector<GLuint> remap(vertices.size(), unused);
+        std::vector<gps::Vertex> result;
+        result.reserve(vertices.size());
+
+        for (size_t i = 0; i < indices.size(); i++) {
+            GLuint& index = indices[i];
+            if (remap[index] == unused) {
+                remap[index] = (GLuint)result.size();
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+
+        vertices.swap(result);
+    }
+}
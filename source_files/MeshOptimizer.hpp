@@ -0,0 +1,32 @@
+#ifndef MeshOptimizer_hpp
+#define MeshOptimizer_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Post-transform cache efficiency of an index buffer on a simulated FIFO cache
+    struct VertexCacheStats {
+        // Average cache misses per triangle (0.5 is ideal for big regular meshes, 3 is the worst)
+        float acmr;
+        // Average transforms per referenced vertex (1 is ideal)
+        float atvr;
+    };
+
+    VertexCacheStats AnalyzeVertexCache(const std::vector<GLuint>& indices, size_t vertexCount, unsigned int cacheSize = 16);
+
+    // Reorders triangles for post-transform vertex cache locality (Forsyth's linear-speed algorithm)
+    void OptimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+    // Reorders the clusters of a cache optimized index buffer so that outward facing
+    // clusters are drawn first. Keeps the ACMR within `threshold` of the input.
+    void OptimizeOverdraw(std::vector<GLuint>& indices, const std::vector<gps::Vertex>& vertices, float threshold = 1.05f);
+
+    // Reorders the vertices in the order the index buffer first uses them and drops unused ones
+    void OptimizeVertexFetch(std::vector<gps::Vertex>& vertices, std::vector<GLuint>& indices);
+}
+
+#endif /* MeshOptimizer_hpp */
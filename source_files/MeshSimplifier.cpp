@@ -0,0 +1,268 @@
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <unordered_map>
+
+namespace gps {
+
+    // Symmetric 4x4 matrix of the squared distance to a set of planes
+    struct Quadric {
+        double a2, ab, ac, ad, b2, bc, bd, c2, cd, d2;
+        double weight;
+
+        void addPlane(double a, double b, double c, double d, double weight) {
+            a2 += weight * a * a; ab += weight * a * b; ac += weight * a * c; ad += weight * a * d;
+            b2 += weight * b * b; bc += weight * b * c; bd += weight * b * d;
+            c2 += weight * c * c; cd += weight * c * d;
+            d2 += weight * d * d;
+            this->weight += weight;
+        }
+
+        void add(const Quadric& q) {
+            a2 += q.a2; ab += q.ab; ac += q.ac; ad += q.ad;
+            b2 += q.b2; bc += q.bc; bd += q.bd;
+            c2 += q.c2; cd += q.cd;
+            d2 += q.d2;
+            weight += q.weight;
+        }
+
+        // weighted mean squared distance to the planes
+        double evaluate(const glm::vec3& p) const {
+            if (weight <= 0.0)
+                return 0.0;
+            double x = p.x, y = p.y, z = p.z;
+            double result = a2 * x * x + 2 * ab * x * y + 2 * ac * x * z + 2 * ad * x
+                + b2 * y * y + 2 * bc * y * z + 2 * bd * y
+                + c2 * z * z + 2 * cd * z
+                + d2;
+            return result > 0.0 ? result / weight : 0.0;
+        }
+    };
+
+    enum VertexKind {
+        VERTEX_MANIFOLD,  // can collapse into any neighbour
+        VERTEX_BORDER,    // on an open edge, only collapses along it
+        VERTEX_LOCKED     // shares its position with other vertices (attribute seam)
+    };
+
+    struct Collapse {
+        GLuint from;
+        GLuint to;
+        double cost;
+    };
+
+    static uint64_t edgeKey(GLuint a, GLuint b) {
+        return ((uint64_t)a << 32) | b;
+    }
+
+    struct PositionHash {
+        size_t operator()(const glm::vec3& p) const {
+            uint32_t bits[3];
+            memcpy(bits, &p, sizeof(bits));
+            return (bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u);
+        }
+    };
+
+    static glm::vec3 triangleNormal(const glm::vec3& p0, const glm::vec3& p1, const glm::vec3& p2) {
+        return glm::cross(p1 - p0, p2 - p0);
+    }
+
+    std::vector<GLuint> SimplifyMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+                                     size_t targetIndexCount, float maxError, float& error)
+    {
+        error = 0.0f;
+        std::vector<GLuint> result(indices.begin(), indices.begin() + indices.size() / 3 * 3);
+        size_t vertexCount = vertices.size();
+        if (result.size() <= targetIndexCount || vertexCount == 0)
+            return result;
+
+        // positions used by more than one vertex are seams
+        std::vector<VertexKind> kind(vertexCount, VERTEX_MANIFOLD);
+        {
+            std::unordered_map<glm::vec3, GLuint, PositionHash> firstAtPosition;
+            firstAtPosition.reserve(vertexCount);
+            for (GLuint v = 0; v < vertexCount; v++) {
+                auto inserted = firstAtPosition.emplace(vertices[v].Position, v);
+                if (!inserted.second) {
+                    kind[v] = VERTEX_LOCKED;
+                    kind[inserted.first->second] = VERTEX_LOCKED;
+                }
+            }
+        }
+
+        // edges without a twin are borders
+        std::unordered_map<uint64_t, unsigned int> edges;
+        edges.reserve(result.size());
+        for (size_t i = 0; i < result.size(); i += 3) {
+            for (int k = 0; k < 3; k++)
+                edges[edgeKey(result[i + k], result[i + (k + 1) % 3])]++;
+        }
+        auto isBorderEdge = [&edges](GLuint a, GLuint b) {
+            return edges.find(edgeKey(b, a)) == edges.end() && edges.find(edgeKey(a, b)) != edges.end();
+        };
+
+        std::vector<Quadric> quadrics(vertexCount);
+        memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+
+        for (size_t i = 0; i < result.size(); i += 3) {
+            GLuint corner[3] = { result[i], result[i + 1], result[i + 2] };
+            const glm::vec3& p0 = vertices[corner[0]].Position;
+            glm::vec3 normal = triangleNormal(p0, vertices[corner[1]].Position, vertices[corner[2]].Position);
+            float area = glm::length(normal);
+            if (area == 0.0f)
+                continue;
+            normal /= area;
+            double d = -glm::dot(normal, p0);
+            for (int k = 0; k < 3; k++)
+                quadrics[corner[k]].addPlane(normal.x, normal.y, normal.z, d, area);
+
+            // keep borders in place with a plane through the edge, perpendicular to the triangle
+            for (int k = 0; k < 3; k++) {
+                GLuint a = corner[k];
+                GLuint b = corner[(k + 1) % 3];
+                if (!isBorderEdge(a, b))
+                    continue;
+                if (kind[a] == VERTEX_MANIFOLD)
+                    kind[a] = VERTEX_BORDER;
+                if (kind[b] == VERTEX_MANIFOLD)
+                    kind[b] = VERTEX_BORDER;
+
+                glm::vec3 edge = vertices[b].Position - vertices[a].Position;
+                glm::vec3 edgeNormal = glm::cross(edge, normal);
+                float edgeLength = glm::length(edgeNormal);
+                if (edgeLength == 0.0f)
+                    continue;
+                edgeNormal /= edgeLength;
+                double edgeD = -glm::dot(edgeNormal, vertices[a].Position);
+                quadrics[a].addPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, edgeD, edgeLength * 10.0);
+                quadrics[b].addPlane(edgeNormal.x, edgeNormal.y, edgeNormal.z, edgeD, edgeLength * 10.0);
+            }
+        }
+
+        const double maxCost = (double)maxError * maxError;
+        std::vector<GLuint> remap(vertexCount);
+        std::vector<bool> touched(vertexCount);
+        std::vector<size_t> adjacencyOffset(vertexCount + 1);
+        std::vector<GLuint> adjacency;
+        std::vector<Collapse> collapses;
+
+        while (result.size() > targetIndexCount) {
+            // vertex -> triangle adjacency of the current index list
+            std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+            for (size_t i = 0; i < result.size(); i++)
+                adjacencyOffset[result[i] + 1]++;
+            for (size_t v = 0; v < vertexCount; v++)
+                adjacencyOffset[v + 1] += adjacencyOffset[v];
+            adjacency.resize(result.size());
+            {
+                std::vector<size_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+                for (size_t i = 0; i < result.size(); i++)
+                    adjacency[fill[result[i]]++] = (GLuint)(i / 3);
+            }
+
+            // cheapest allowed collapse for every vertex
+            collapses.clear();
+            for (size_t i = 0; i < result.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    for (int direction = 0; direction < 2; direction++) {
+                        GLuint from = result[i + k];
+                        GLuint to = result[i + (k + 1 + direction) % 3];
+                        if (kind[from] == VERTEX_LOCKED)
+                            continue;
+                        if (kind[from] == VERTEX_BORDER &&
+                            (kind[to] == VERTEX_MANIFOLD || (!isBorderEdge(from, to) && !isBorderEdge(to, from))))
+                            continue;
+
+                        double cost = quadrics[from].evaluate(vertices[to].Position);
+                        if (cost > maxCost)
+                            continue;
+                        Collapse collapse = { from, to, cost };
+                        collapses.push_back(collapse);
+                    }
+                }
+            }
+
+            if (collapses.empty())
+                break;
+
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+                return a.cost < b.cost;
+            });
+
+            for (size_t v = 0; v < vertexCount; v++)
+                remap[v] = (GLuint)v;
+            std::fill(touched.begin(), touched.end(), false);
+
+            // each collapse removes about two triangles
+            size_t trianglesToRemove = (result.size() - targetIndexCount) / 3;
+            size_t removed = 0;
+            double passCost = 0.0;
+
+            for (size_t c = 0; c < collapses.size() && removed < trianglesToRemove; c++) {
+                GLuint from = collapses[c].from;
+                GLuint to = collapses[c].to;
+                if (touched[from] || touched[to])
+                    continue;
+
+                // reject collapses that flip a triangle around `from`
+                bool flips = false;
+                size_t collapsedTriangles = 0;
+                const glm::vec3& target = vertices[to].Position;
+                for (size_t a = adjacencyOffset[from]; a < adjacencyOffset[from + 1] && !flips; a++) {
+                    size_t t = adjacency[a];
+                    GLuint corner[3] = { result[3 * t], result[3 * t + 1], result[3 * t + 2] };
+                    if (corner[0] == to || corner[1] == to || corner[2] == to) {
+                        collapsedTriangles++;
+                        continue;
+                    }
+                    glm::vec3 p[3];
+                    for (int k = 0; k < 3; k++)
+                        p[k] = vertices[corner[k]].Position;
+                    glm::vec3 before = triangleNormal(p[0], p[1], p[2]);
+                    for (int k = 0; k < 3; k++)
+                        if (corner[k] == from)
+                            p[k] = target;
+                    glm::vec3 after = triangleNormal(p[0], p[1], p[2]);
+                    if (glm::dot(before, after) <= 0.0f)
+                        flips = true;
+                }
+                if (flips)
+                    continue;
+
+                // lock the one-ring, its triangles are only valid for this collapse
+                for (size_t a = adjacencyOffset[from]; a < adjacencyOffset[from + 1]; a++) {
+                    size_t t = adjacency[a];
+                    for (int k = 0; k < 3; k++)
+                        touched[result[3 * t + k]] = true;
+                }
+
+                remap[from] = to;
+                quadrics[to].add(quadrics[from]);
+                removed += collapsedTriangles;
+                passCost = std::max(passCost, collapses[c].cost);
+            }
+
+            if (removed == 0)
+                break;
+
+            error = std::max(error, (float)std::sqrt(passCost));
+
+            size_t write = 0;
+            for (size_t i = 0; i < result.size(); i += 3) {
+                GLuint a = remap[result[i]];
+                GLuint b = remap[result[i + 1]];
+                GLuint c = remap[result[i + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                result[write++] = a;
+                result[write++] = b;
+                result[write++] = c;
+            }
+            result.resize(write);
+        }
+
+        return result;
+    }
+}
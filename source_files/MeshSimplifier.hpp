@@ -0,0 +1,21 @@
+#ifndef MeshSimplifier_hpp
+#define MeshSimplifier_hpp
+
+#include "Mesh.hpp"
+
+#include <cstddef>
+#include <vector>
+
+namespace gps {
+
+    // Quadric error edge collapse (Garland-Heckbert) restricted to the existing vertices,
+    // so every level of detail can share the vertex buffer of the full mesh.
+    // Vertices on uv/normal seams are kept, open borders only collapse along themselves.
+    // Collapses until at most targetIndexCount indices remain or the next collapse would
+    // move the surface by more than maxError (model units).
+    // Returns the simplified index list, `error` receives the largest deviation introduced.
+    std::vector<GLuint> SimplifyMesh(const std::vector<gps::Vertex>& vertices, const std::vector<GLuint>& indices,
+                                     size_t targetIndexCount, float maxError, float& error);
+}
+
+#endif /* MeshSimplifier_hpp */
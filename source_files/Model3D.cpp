@@ -1,38 +1,249 @@
 #include "Model3D.hpp"
+#include "MeshCache.hpp"
+#include "MappedFile.hpp"
+#include "MeshOptimizer.hpp"
+#include "MeshSimplifier.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
 
 namespace gps {
 
+	// Identifies a unique face corner by its position/normal/texcoord indices
+	struct VertexKey {
+		int vertexIndex;
+		int normalIndex;
+		int texcoordIndex;
+
+		bool operator==(const VertexKey& other) const {
+			return vertexIndex == other.vertexIndex && normalIndex == other.normalIndex && texcoordIndex == other.texcoordIndex;
+		}
+	};
+
+	struct VertexKeyHash {
+		size_t operator()(const VertexKey& key) const {
+			size_t h = static_cast<size_t>(key.vertexIndex) * 73856093u;
+			h ^= static_cast<size_t>(key.normalIndex) * 19349663u;
+			h ^= static_cast<size_t>(key.texcoordIndex) * 83492791u;
+			return h;
+		}
+	};
+
+	// tinyobj's .mtl reader, also listing the files it reads
+	class ListingMaterialReader : public tinyobj::MaterialFileReader {
+	public:
+		ListingMaterialReader(const std::string& basePath, std::vector<std::string>& files)
+			: tinyobj::MaterialFileReader(basePath), basePath(basePath), files(files) {}
+
+		virtual bool operator()(const std::string& matId, std::vector<tinyobj::material_t>* materials,
+			std::map<std::string, int>* matMap, std::string* err) {
+			files.push_back(basePath + matId);
+			return tinyobj::MaterialFileReader::operator()(matId, materials, matMap, err);
+		}
+
+	private:
+		std::string basePath;
+		std::vector<std::string>& files;
+	};
+
+	// Serializes the loading reports of models read on different threads
+	static std::mutex logMutex;
+
+	bool Model3D::useMeshCache = true;
+
+	unsigned int Model3D::parseThreads = 0;
+
+	bool Model3D::optimizeMeshes = true;
+
+	bool Model3D::generateLods = true;
+
+	float Model3D::lodPixelError = 1.0f;
+
+	// Levels of detail: each one halves the triangles of the previous one
+	const int MAX_LOD_LEVELS = 4;
+	const size_t MIN_LOD_TRIANGLES = 128;
+	// give up on a level that removes less than this fraction of the triangles
+	const float MIN_LOD_REDUCTION = 0.15f;
+	// largest deviation a level may introduce, relative to the mesh radius
+	const float MAX_LOD_ERROR = 0.1f;
+
 	void Model3D::LoadModel(std::string fileName)
 	{
-        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
-		ReadOBJ(fileName, basePath);
+		LoadModelData(fileName);
+		UploadModel();
 	}
 
     void Model3D::LoadModel(std::string fileName, std::string basePath)
 	{
+		LoadModelData(fileName, basePath);
+		UploadModel();
+	}
+
+	void Model3D::LoadModelData(std::string fileName)
+	{
+        std::string basePath = fileName.substr(0, fileName.find_last_of('/')) + "/";
+		// one cache-aware path for both overloads
+		LoadModelData(fileName, basePath);
+	}
+
+	void Model3D::LoadModelData(std::string fileName, std::string basePath)
+	{
+		std::string cacheFile = fileName + ".meshcache";
+		// the options that change the meshes, a cache built with others is stale
+		uint32_t cacheOptions = (optimizeMeshes ? MESH_CACHE_OPTIMIZED : 0) | (generateLods ? MESH_CACHE_LODS : 0);
+
+		if (useMeshCache && ReadMeshCache(cacheFile, fileName, basePath, cacheOptions, meshes)) {
+			// the cache only knows the texture files, the images still have to be decoded
+			for (size_t i = 0; i < meshes.size(); i++) {
+				for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+					meshes[i].textures[t] = LoadTexture(meshes[i].textures[t].path, meshes[i].textures[t].type);
+				}
+			}
+
+			ComputeBounds();
+
+			std::lock_guard<std::mutex> lock(logMutex);
+			std::cout << "Loading : " << fileName << " (cached, " << meshes.size() << " meshes)" << std::endl;
+			return;
+		}
+
 		ReadOBJ(fileName, basePath);
+		ComputeBounds();
+
+		if (useMeshCache && !WriteMeshCache(cacheFile, fileName, materialFiles, basePath, cacheOptions, meshes)) {
+			std::lock_guard<std::mutex> lock(logMutex);
+			std::cerr << "WARNING: could not write mesh cache " << cacheFile << std::endl;
+		}
 	}
 
-	// Draw each mesh from the model
-	void Model3D::Draw(gps::Shader shaderProgram)
+	void Model3D::UploadModel()
 	{
-		for (int i = 0; i < meshes.size(); i++)
-			meshes[i].Draw(shaderProgram);
+		for (size_t i = 0; i < pendingImages.size(); i++) {
+			GLuint textureID = UploadTexture(pendingImages[i]);
+			stbi_image_free(pendingImages[i].pixels);
+
+			for (size_t j = 0; j < loadedTextures.size(); j++) {
+				if (loadedTextures[j].path == pendingImages[i].path)
+					loadedTextures[j].id = textureID;
+			}
+		}
+		pendingImages.clear();
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			// textures were handed out before their ids existed
+			for (size_t t = 0; t < meshes[i].textures.size(); t++) {
+				for (size_t j = 0; j < loadedTextures.size(); j++) {
+					if (loadedTextures[j].path == meshes[i].textures[t].path)
+						meshes[i].textures[t].id = loadedTextures[j].id;
+				}
+			}
+			meshes[i].setupMesh();
+		}
+	}
+
+	void Model3D::ComputeBounds()
+	{
+		boundsMin = glm::vec3(0.0f);
+		boundsMax = glm::vec3(0.0f);
+		for (size_t i = 0; i < meshes.size(); i++) {
+			boundsMin = i == 0 ? meshes[i].boundsMin : glm::min(boundsMin, meshes[i].boundsMin);
+			boundsMax = i == 0 ? meshes[i].boundsMax : glm::max(boundsMax, meshes[i].boundsMax);
+		}
+
+		boundsCenter = (boundsMin + boundsMax) * 0.5f;
+		boundsRadius = 0.0f;
+		for (size_t i = 0; i < meshes.size(); i++)
+			boundsRadius = std::max(boundsRadius, glm::length(meshes[i].boundsCenter - boundsCenter) + meshes[i].boundsRadius);
+	}
+
+	// Picks a level of detail for each mesh from its projected size at modelMatrix
+	void Model3D::SelectLod(const glm::mat4& modelMatrix, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+		float viewportHeight, int* levels) const
+	{
+		glm::mat4 modelView = viewMatrix * modelMatrix;
+		float scale = std::max(glm::length(glm::vec3(modelMatrix[0])),
+			std::max(glm::length(glm::vec3(modelMatrix[1])), glm::length(glm::vec3(modelMatrix[2]))));
+		// pixels covered by one world unit at distance 1
+		float pixelsPerUnit = scale * projectionMatrix[1][1] * 0.5f * viewportHeight;
+
+		for (size_t i = 0; i < meshes.size(); i++) {
+			glm::vec3 center = glm::vec3(modelView * glm::vec4(meshes[i].boundsCenter, 1.0f));
+			// nearest point of the bounding sphere
+			float distance = std::max(glm::length(center) - meshes[i].boundsRadius * scale, 0.01f);
+			levels[i] = meshes[i].selectLod(levels[i], pixelsPerUnit / distance, lodPixelError);
+		}
+	}
+
+	uint32_t Model3D::WriteTransforms(gps::TransformBuffer& transforms, const glm::mat4* modelMatrices,
+		const glm::mat3* normalMatrices, uint32_t instanceCount, bool modified)
+	{
+		bool changed;
+		uint32_t first = transforms.allocate((uint32_t)meshes.size() * instanceCount, modified, changed);
+		if (changed) {
+			// mesh-major, the instances of one mesh are consecutive
+			for (uint32_t k = 0; k < instanceCount; k++) {
+				for (size_t i = 0; i < meshes.size(); i++)
+					transforms.write(first + (uint32_t)i * instanceCount + k, modelMatrices[k] * meshes[i].dequantize, normalMatrices[k]);
+			}
+		}
+		return first;
+	}
+
+	void Model3D::Submit(gps::RenderQueue& queue, const glm::mat4& modelMatrix, const int* levels, uint32_t firstTransform,
+		uint32_t instanceCount, GLuint program, const glm::vec4& depthPlane, float maxDepth, bool shadowPass)
+	{
+		for (size_t i = 0; i < meshes.size(); i++) {
+			float depth = glm::dot(depthPlane, modelMatrix * glm::vec4(meshes[i].boundsCenter, 1.0f));
+			uint64_t key;
+			if (shadowPass)
+				key = gps::RenderQueue::shadowKey(program, meshes[i].depthVertexArray(), depth);
+			else if (gps::Mesh::pooledGeometry)
+				key = gps::RenderQueue::batchKey(program, meshes[i].getIndexType(), meshes[i].textureSet, depth);
+			else
+				key = gps::RenderQueue::mainKey(program, meshes[i].textureSet, depth, maxDepth);
+			queue.add(key, &meshes[i], meshes[i].lods[levels[i]], firstTransform + (uint32_t)i * instanceCount, instanceCount);
+		}
+	}
+
+	void Model3D::Draw(gps::Shader& shaderProgram, const glm::mat4& modelMatrix)
+	{
+		shaderProgram.useShaderProgram();
+
+		for (int i = 0; i < meshes.size(); i++) {
+			shaderProgram.setMat4(gps::UNIFORM_MODEL, modelMatrix * meshes[i].dequantize);
+			meshes[i].Draw(shaderProgram, meshes[i].lods[0]);
+		}
 	}
 
 	// Does the parsing of the .obj file and fills in the data structure
 	void Model3D::ReadOBJ(std::string fileName, std::string basePath){
 
-        std::cout << "Loading : " << fileName << std::endl;
+		std::ostringstream log;
+        log << "Loading : " << fileName << std::endl;
 		tinyobj::attrib_t attrib;
 		std::vector<tinyobj::shape_t> shapes;
 		std::vector<tinyobj::material_t> materials;
 		int materialId;
 
 		std::string err;
-		bool ret = tinyobj::LoadObj(&attrib, &shapes, &materials, &err, fileName.c_str(), basePath.c_str(), GL_TRUE);
+		// parse straight out of the mapped file
+		bool ret = false;
+		gps::MappedFile objFile;
+		if (objFile.open(fileName)) {
+			materialFiles.clear();
+			ListingMaterialReader materialReader(basePath, materialFiles);
+			unsigned int threads = parseThreads ? parseThreads : std::max(1u, std::thread::hardware_concurrency());
+			ret = tinyobj::LoadObjFromBuffer(&attrib, &shapes, &materials, &err, objFile.data(), objFile.size(), &materialReader, GL_TRUE, threads);
+		}
+		else {
+			err = "Cannot open file [" + fileName + "]";
+		}
 
 		if (!err.empty()) { // `err` may contain warning message.
+			std::lock_guard<std::mutex> lock(logMutex);
 			std::cerr << err << std::endl;
 		}
 
@@ -40,8 +251,11 @@ namespace gps {
 			exit(1);
 		}
 
-		std::cout << "# of shapes    : " << shapes.size() << std::endl;
-		std::cout << "# of materials : " << materials.size() << std::endl;
+		log << "# of shapes    : " << shapes.size() << std::endl;
+		log << "# of materials : " << materials.size() << std::endl;
+
+		size_t totalCorners = 0;
+		size_t totalVertices = 0;
 
 		// Loop over shapes
 		for (size_t s = 0; s < shapes.size(); s++) {
@@ -49,25 +263,41 @@ namespace gps {
 			std::vector<GLuint> indices;
 			std::vector<gps::Texture> textures;
 
+			// Weld face corners that reference the same (position, normal, texcoord) triple
+			size_t cornerCount = shapes[s].mesh.indices.size();
+			std::unordered_map<VertexKey, GLuint, VertexKeyHash> uniqueVertices;
+			uniqueVertices.reserve(cornerCount);
+			vertices.reserve(cornerCount);
+			indices.reserve(cornerCount);
+
 			// Loop over faces(polygon)
 			size_t index_offset = 0;
 			for (size_t f = 0; f < shapes[s].mesh.num_face_vertices.size(); f++) {
 				int fv = shapes[s].mesh.num_face_vertices[f];
 
-				//gps::Texture currentTexture = LoadTexture("index1.png", "ambientTexture");
-				//textures.push_back(currentTexture);
-
 				// Loop over vertices in the face.
 				for (size_t v = 0; v < fv; v++) {
 					// access to vertex
 					tinyobj::index_t idx = shapes[s].mesh.indices[index_offset + v];
 
+					VertexKey key = { idx.vertex_index, idx.normal_index, idx.texcoord_index };
+					auto found = uniqueVertices.find(key);
+					if (found != uniqueVertices.end()) {
+						indices.push_back(found->second);
+						continue;
+					}
+
 					float vx = attrib.vertices[3 * idx.vertex_index + 0];
 					float vy = attrib.vertices[3 * idx.vertex_index + 1];
 					float vz = attrib.vertices[3 * idx.vertex_index + 2];
-					float nx = attrib.normals[3 * idx.normal_index + 0];
-					float ny = attrib.normals[3 * idx.normal_index + 1];
-					float nz = attrib.normals[3 * idx.normal_index + 2];
+					float nx = 0.0f;
+					float ny = 0.0f;
+					float nz = 0.0f;
+					if (idx.normal_index != -1) {
+						nx = attrib.normals[3 * idx.normal_index + 0];
+						ny = attrib.normals[3 * idx.normal_index + 1];
+						nz = attrib.normals[3 * idx.normal_index + 2];
+					}
 					float tx = 0.0f;
 					float ty = 0.0f;
 					if (idx.texcoord_index != -1) {
@@ -84,21 +314,80 @@ namespace gps {
 					currentVertex.Normal = vertexNormal;
 					currentVertex.TexCoords = vertexTexCoords;
 
+					GLuint newIndex = static_cast<GLuint>(vertices.size());
+					uniqueVertices.emplace(key, newIndex);
 					vertices.push_back(currentVertex);
 
-					indices.push_back(index_offset + v);
+					indices.push_back(newIndex);
 				}
 
 				index_offset += fv;
 			}
 
+			// Reorder for the post-transform cache, then overdraw, then vertex fetch
+			if (optimizeMeshes) {
+				gps::VertexCacheStats before = gps::AnalyzeVertexCache(indices, vertices.size());
+				gps::OptimizeVertexCache(indices, vertices.size());
+				gps::OptimizeOverdraw(indices, vertices);
+				gps::OptimizeVertexFetch(vertices, indices);
+				gps::VertexCacheStats after = gps::AnalyzeVertexCache(indices, vertices.size());
+
+				log << "  mesh " << s << " (" << indices.size() / 3 << " triangles) : ACMR "
+					<< before.acmr << " -> " << after.acmr << ", ATVR "
+					<< before.atvr << " -> " << after.atvr << std::endl;
+			}
+
+			// Index-only levels of detail appended after the full index list
+			std::vector<gps::MeshLod> lods;
+			gps::MeshLod fullMesh = { 0, (GLuint)indices.size(), 0.0f };
+			lods.push_back(fullMesh);
+
+			if (generateLods && indices.size() / 3 >= MIN_LOD_TRIANGLES) {
+				glm::vec3 boundsMin = vertices[0].Position;
+				glm::vec3 boundsMax = vertices[0].Position;
+				for (size_t i = 1; i < vertices.size(); i++) {
+					boundsMin = glm::min(boundsMin, vertices[i].Position);
+					boundsMax = glm::max(boundsMax, vertices[i].Position);
+				}
+				float maxError = glm::length(boundsMax - boundsMin) * 0.5f * MAX_LOD_ERROR;
+
+				std::vector<GLuint> previous(indices);
+				float error = 0.0f;
+				while (lods.size() < MAX_LOD_LEVELS && previous.size() / 3 >= MIN_LOD_TRIANGLES) {
+					float levelError;
+					std::vector<GLuint> level = gps::SimplifyMesh(vertices, previous, previous.size() / 2, maxError, levelError);
+					if (level.empty() || level.size() > previous.size() * (1.0f - MIN_LOD_REDUCTION))
+						break;
+					gps::OptimizeVertexCache(level, vertices.size());
+
+					// each level is measured against the previous one, the bound against the full mesh is the sum
+					error += levelError;
+					gps::MeshLod lod = { (GLuint)indices.size(), (GLuint)level.size(), error };
+					lods.push_back(lod);
+					indices.insert(indices.end(), level.begin(), level.end());
+					previous.swap(level);
+				}
+
+				if (lods.size() > 1) {
+					log << "  mesh " << s << " LODs :";
+					for (size_t l = 0; l < lods.size(); l++)
+						log << " " << lods[l].indexCount / 3;
+					log << " triangles (max error " << lods.back().error << ")" << std::endl;
+				}
+			}
+
+			vertices.shrink_to_fit();
+			totalCorners += cornerCount;
+			totalVertices += vertices.size();
+
+			gps::Material currentMaterial = { glm::vec3(0.0f), glm::vec3(0.0f), glm::vec3(0.0f) };
+
 			// get material id
 			// Only try to read materials if the .mtl file is present
 			int a = shapes[s].mesh.material_ids.size();
 			if (a > 0 && materials.size()>0) {
 				materialId = shapes[s].mesh.material_ids[0];
 				if (materialId != -1) {
-					gps::Material currentMaterial;
 					currentMaterial.ambient = glm::vec3(materials[materialId].ambient[0], materials[materialId].ambient[1], materials[materialId].ambient[2]);
 					currentMaterial.diffuse = glm::vec3(materials[materialId].diffuse[0], materials[materialId].diffuse[1], materials[materialId].diffuse[2]);
 					currentMaterial.specular = glm::vec3(materials[materialId].specular[0], materials[materialId].specular[1], materials[materialId].specular[2]);
@@ -132,11 +421,23 @@ namespace gps {
 				}
 			}
 
-			meshes.push_back(gps::Mesh(vertices, indices, textures));
+			gps::Mesh mesh(std::move(vertices), std::move(indices), std::move(textures));
+			mesh.material = currentMaterial;
+			mesh.lods = lods;
+			meshes.push_back(std::move(mesh));
 		}
+
+		size_t indexBytes = totalCorners * sizeof(GLuint);
+		log << "# of vertices  : " << totalCorners << " -> " << totalVertices
+			<< " (" << (totalCorners * sizeof(gps::Vertex) + indexBytes) / 1024 << " KB -> "
+			<< (totalVertices * sizeof(gps::Vertex) + indexBytes) / 1024 << " KB)" << std::endl;
+
+		std::lock_guard<std::mutex> lock(logMutex);
+		std::cout << log.str();
 	}
 
 	// Retrieves a texture associated with the object - by its name and type
+	// The pixel data is only decoded here, UploadModel() creates the GL texture
 	gps::Texture Model3D::LoadTexture(std::string path, std::string type) {
 
 			for (int i = 0; i < loadedTextures.size(); i++) {
@@ -148,17 +449,22 @@ namespace gps {
 			}
 
 			gps::Texture currentTexture;
-			currentTexture.id = ReadTextureFromFile(path.c_str());
+			currentTexture.id = 0;
 			currentTexture.type = std::string(type);
 			currentTexture.path = path;
 
+			gps::ImageData image;
+			if (ReadImageFromFile(path.c_str(), image)) {
+				pendingImages.push_back(image);
+			}
+
 			loadedTextures.push_back(currentTexture);
 
 			return currentTexture;
 		}
 
-	// Reads the pixel data from an image file and loads it into the video memory
-	GLuint Model3D::ReadTextureFromFile(const char* file_name) {
+	// Reads the pixel data from an image file, flipped for OpenGL
+	bool Model3D::ReadImageFromFile(const char* file_name, gps::ImageData& image) {
 		int x, y, n;
 		int force_channels = 4;
 		unsigned char* image_data = stbi_load(file_name, &x, &y, &n, force_channels);
@@ -191,6 +497,16 @@ namespace gps {
 			}
 		}
 
+		image.path = file_name;
+		image.width = x;
+		image.height = y;
+		image.pixels = image_data;
+
+		return true;
+	}
+
+	// Loads decoded pixel data into the video memory
+	GLuint Model3D::UploadTexture(const gps::ImageData& image) {
 		GLuint textureID;
 		glGenTextures(1, &textureID);
 		glBindTexture(GL_TEXTURE_2D, textureID);
@@ -198,12 +514,12 @@ namespace gps {
 			GL_TEXTURE_2D,
 			0,
 			GL_SRGB, //GL_SRGB,//GL_RGBA,
-			x,
-			y,
+			image.width,
+			image.height,
 			0,
 			GL_RGBA,
 			GL_UNSIGNED_BYTE,
-			image_data
+			image.pixels
 		);
 		glGenerateMipmap(GL_TEXTURE_2D);
 
@@ -228,6 +544,10 @@ namespace gps {
             glDeleteBuffers(1, &VBO);
             glDeleteBuffers(1, &EBO);
             glDeleteVertexArrays(1, &VAO);
+            GLuint positionVBO = meshes.at(i).getBuffers().positionVBO;
+            GLuint depthVAO = meshes.at(i).getBuffers().depthVAO;
+            glDeleteBuffers(1, &positionVBO);
+            glDeleteVertexArrays(1, &depthVAO);
         }
 	}
 }
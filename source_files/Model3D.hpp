@@ -2,6 +2,8 @@
 #define Model3D_hpp
 
 #include "Mesh.hpp"
+#include "RenderQueue.hpp"
+#include "TransformBuffer.hpp"
 
 #include "tiny_obj_loader.h"
 #include "stb_image.h"
@@ -12,6 +14,14 @@
 
 namespace gps {
 
+	// Decoded image waiting to be uploaded to the video memory
+	struct ImageData {
+		std::string path;
+		int width;
+		int height;
+		unsigned char* pixels;
+	};
+
     class Model3D
     {
 
@@ -22,22 +32,80 @@ namespace gps {
 
 		void LoadModel(std::string fileName, std::string basePath);
 
-		void Draw(gps::Shader shaderProgram);
+		// CPU side of LoadModel (.obj parsing, image decoding) - safe to run on a worker thread
+		void LoadModelData(std::string fileName);
+
+		void LoadModelData(std::string fileName, std::string basePath);
+
+		// GL side of LoadModel (buffers, textures) - must run on the context thread
+		void UploadModel();
+
+		// Keep a binary copy of the parsed meshes next to each .obj and reuse it on the next launch
+		static bool useMeshCache;
+
+		// Threads used to parse a single large .obj file (0 = one per core); the parallel model
+		// loader sets 1 while its workers run
+		static unsigned int parseThreads;
+
+		// Reorder triangles and vertices of each mesh for the vertex cache, overdraw and fetch locality
+		static bool optimizeMeshes;
+
+		// Build simplified levels of detail for each mesh at load time
+		static bool generateLods;
+
+		// Screen-space error (pixels) allowed when picking a level of detail
+		static float lodPixelError;
+
+		// Bounds of all meshes in model space, valid after LoadModelData
+		glm::vec3 boundsMin;
+		glm::vec3 boundsMax;
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+
+		// Draws every mesh at full detail with its dequantize matrix folded into the "model" uniform
+		void Draw(gps::Shader& shaderProgram, const glm::mat4& modelMatrix);
+
+		// Picks each mesh's level of detail from its projected size. levels holds one entry per mesh,
+		// owned by the caller for each placement of the model and updated in place
+		void SelectLod(const glm::mat4& modelMatrix, const glm::mat4& viewMatrix, const glm::mat4& projectionMatrix,
+			float viewportHeight, int* levels) const;
+
+		size_t MeshCount() const { return meshes.size(); }
+
+		// Reserves one transform slot per mesh and instance (written only while modified is recent),
+		// returns the first one
+		uint32_t WriteTransforms(gps::TransformBuffer& transforms, const glm::mat4* modelMatrices,
+			const glm::mat3* normalMatrices, uint32_t instanceCount, bool modified);
+
+		// Queues every mesh as one instanced draw at levels[mesh] (from SelectLod); depth =
+		// dot(depthPlane, world position) of the mesh centre placed with modelMatrix (the nearest instance)
+		void Submit(gps::RenderQueue& queue, const glm::mat4& modelMatrix, const int* levels, uint32_t firstTransform,
+			uint32_t instanceCount, GLuint program, const glm::vec4& depthPlane, float maxDepth, bool shadowPass);
 
     private:
 		// Component meshes - group of objects
         std::vector<gps::Mesh> meshes;
 		// Associated textures
         std::vector<gps::Texture> loadedTextures;
+		// Textures decoded by LoadModelData, not yet uploaded
+		std::vector<gps::ImageData> pendingImages;
+		// .mtl files read by ReadOBJ, the mesh cache checks them too
+		std::vector<std::string> materialFiles;
 
 		// Does the parsing of the .obj file and fills in the data structure
 		void ReadOBJ(std::string fileName, std::string basePath);
 
+		// Merges the mesh bounds into the model bounds
+		void ComputeBounds();
+
 		// Retrieves a texture associated with the object - by its name and type
 		gps::Texture LoadTexture(std::string path, std::string type);
 
-		// Reads the pixel data from an image file and loads it into the video memory
-		GLuint ReadTextureFromFile(const char* file_name);
+		// Reads the pixel data from an image file, flipped for OpenGL
+		bool ReadImageFromFile(const char* file_name, gps::ImageData& image);
+
+		// Loads decoded pixel data into the video memory
+		GLuint UploadTexture(const gps::ImageData& image);
     };
 }
 
@@ -0,0 +1,67 @@
+#include "RenderQueue.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace gps {
+
+    // Key layout, most significant first:
+    //   main:   program (8) | depth band (4)    | texture set (20) | depth (32)
+    //   batch:  program (8) | texture set (24)                     | depth (32)
+    //   shadow: program (8) | vertex array (24)                    | depth (32)
+    const int DEPTH_BANDS = 16;
+
+    // positive floats sort like their bit patterns
+    static uint32_t depthBits(float depth)
+    {
+        if (!(depth > 0.0f))
+            return 0;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        return bits;
+    }
+
+    void RenderQueue::clear()
+    {
+        items.clear();
+    }
+
+    void RenderQueue::add(uint64_t key, gps::Mesh* mesh, const gps::MeshLod& level, uint32_t transform, uint32_t instances)
+    {
+        Item item = { key, mesh, level, transform, instances };
+        items.push_back(item);
+    }
+
+    void RenderQueue::sort()
+    {
+        std::sort(items.begin(), items.end(), [](const Item& a, const Item& b) {
+            return a.key < b.key;
+        });
+    }
+
+    uint64_t RenderQueue::mainKey(GLuint program, uint32_t textureSet, float depth, float maxDepth)
+    {
+        int band = maxDepth > 0.0f ? (int)(depth / maxDepth * DEPTH_BANDS) : 0;
+        band = std::min(std::max(band, 0), DEPTH_BANDS - 1);
+
+        return ((uint64_t)(program & 0xFF) << 56)
+            | ((uint64_t)band << 52)
+            | ((uint64_t)(textureSet & 0xFFFFF) << 32)
+            | depthBits(depth);
+    }
+
+    uint64_t RenderQueue::batchKey(GLuint program, GLenum indexType, uint32_t textureSet, float depth)
+    {
+        return ((uint64_t)(program & 0xFF) << 56)
+            | ((uint64_t)(indexType == GL_UNSIGNED_SHORT ? 1 : 0) << 55)
+            | ((uint64_t)(textureSet & 0x7FFFFF) << 32)
+            | depthBits(depth);
+    }
+
+    uint64_t RenderQueue::shadowKey(GLuint program, GLuint vertexArray, float depth)
+    {
+        return ((uint64_t)(program & 0xFF) << 56)
+            | ((uint64_t)(vertexArray & 0xFFFFFF) << 32)
+            | depthBits(depth);
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef RenderQueue_hpp
+#define RenderQueue_hpp
+
+#include "Mesh.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Flat list of mesh draws sorted by a 64-bit state key.
+    // Cleared every pass, the arrays keep their capacity between frames.
+    class RenderQueue
+    {
+    public:
+        struct Item {
+            uint64_t key;
+            gps::Mesh* mesh;
+            // index range of the level of detail chosen for this draw
+            gps::MeshLod level;
+            // slot of the mesh's first transform in the TransformBuffer,
+            // the other instances follow it
+            uint32_t transform;
+            uint32_t instances;
+        };
+
+        void clear();
+
+        void add(uint64_t key, gps::Mesh* mesh, const gps::MeshLod& level, uint32_t transform, uint32_t instances);
+
+        void sort();
+
+        size_t size() const { return items.size(); }
+        const Item& operator[](size_t i) const { return items[i]; }
+
+        // Main pass: program | coarse depth | texture set | depth.
+        // Front to back within each depth band, texture sets grouped inside a band.
+        static uint64_t mainKey(GLuint program, uint32_t textureSet, float depth, float maxDepth);
+
+        // Main pass with pooled geometry: program | index type | texture set | depth.
+        // Every texture set of each index buffer becomes one multi-draw, front to back inside it.
+        static uint64_t batchKey(GLuint program, GLenum indexType, uint32_t textureSet, float depth);
+
+        // Shadow pass: program | vertex array | depth, no texture state
+        static uint64_t shadowKey(GLuint program, GLuint vertexArray, float depth);
+
+    private:
+        std::vector<Item> items;
+    };
+}
+
+#endif /* RenderQueue_hpp */
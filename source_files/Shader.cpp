@@ -1,6 +1,38 @@
 #include "Shader.hpp"
+#include "GLStateCache.hpp"
+#include "FrameUniforms.hpp"
+#include "Mesh.hpp"
+
+#include <algorithm>
 
 namespace gps {
+
+    // Names of the UniformSlot entries, same order
+    static const char* UNIFORM_SLOT_NAMES[UNIFORM_SLOT_COUNT] = {
+        "model",
+        "packedNormals",
+        "diffuseTexture",
+        "specularTexture",
+        "ambientTexture",
+        "shadowMap",
+        "depthMap",
+        "skybox",
+        "transforms",
+        "cascade",
+        "shadowAtlas",
+        "atlasTile",
+        "shadowMapCompare",
+        "shadowMoments",
+        "blurSource",
+        "blurVertical",
+        "clusterLights",
+        "clusterRanges",
+        "clusterIndices",
+        "gAlbedoSpecular",
+        "gNormal",
+        "gDepth"
+    };
+
     std::string Shader::readShaderFile(std::string fileName)
     {
         std::ifstream shaderFile;
@@ -19,7 +51,25 @@ namespace gps {
 
         //convert stream into GLchar array
         shaderString = shaderStringStream.str();
-        return shaderString;
+
+        // GLSL has no includes: splice each #include "file" line, relative to this file's directory
+        std::string directory = fileName.substr(0, fileName.find_last_of("/\\") + 1);
+        std::string expanded;
+        std::istringstream lines(shaderString);
+        std::string line;
+        while (std::getline(lines, line)) {
+            size_t directive = line.find_first_not_of(" \t");
+            if (directive != std::string::npos && line.compare(directive, 8, "#include") != 0)
+                directive = std::string::npos;
+            size_t open = line.find('"', directive);
+            size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+            if (directive == std::string::npos || close == std::string::npos) {
+                expanded += line + "\n";
+                continue;
+            }
+            expanded += readShaderFile(directory + line.substr(open + 1, close - open - 1));
+        }
+        return expanded;
     }
 
     void Shader::shaderCompileLog(GLuint shaderId)
@@ -80,11 +130,85 @@ namespace gps {
         glDeleteShader(fragmentShader);
         //check linking info
         shaderLinkLog(this->shaderProgram);
+
+        introspectUniforms();
+    }
+
+    void Shader::introspectUniforms()
+    {
+        uniforms.clear();
+
+        GLint count = 0;
+        GLint maxLength = 0;
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORMS, &count);
+        glGetProgramiv(this->shaderProgram, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxLength);
+
+        std::vector<GLchar> name(std::max(maxLength, 1));
+        for (GLint i = 0; i < count; i++) {
+            GLsizei length = 0;
+            UniformInfo uniform;
+            glGetActiveUniform(this->shaderProgram, (GLuint)i, (GLsizei)name.size(), &length, &uniform.size, &uniform.type, name.data());
+            uniform.name.assign(name.data(), length);
+            uniform.location = glGetUniformLocation(this->shaderProgram, uniform.name.c_str());
+
+            // arrays are reported as "name[0]"
+            size_t bracket = uniform.name.find('[');
+            if (bracket != std::string::npos)
+                uniform.name.resize(bracket);
+
+            // uniforms inside blocks have no location
+            if (uniform.location >= 0)
+                uniforms.push_back(uniform);
+        }
+
+        std::sort(uniforms.begin(), uniforms.end(), [](const UniformInfo& a, const UniformInfo& b) {
+            return a.name < b.name;
+        });
+
+        for (int slot = 0; slot < UNIFORM_SLOT_COUNT; slot++)
+            slotLocations[slot] = getUniform(UNIFORM_SLOT_NAMES[slot]);
+
+        useShaderProgram();
+        setInt(UNIFORM_DIFFUSE_TEXTURE, TEXTURE_UNIT_DIFFUSE);
+        setInt(UNIFORM_SPECULAR_TEXTURE, TEXTURE_UNIT_SPECULAR);
+        setInt(UNIFORM_AMBIENT_TEXTURE, TEXTURE_UNIT_AMBIENT);
+        setInt(UNIFORM_SHADOW_MAP, TEXTURE_UNIT_SHADOW_MAP);
+        setInt(UNIFORM_DEPTH_MAP, 0);
+        setInt(UNIFORM_SKYBOX, 0);
+        setInt(UNIFORM_TRANSFORMS, TEXTURE_UNIT_TRANSFORMS);
+        setInt(UNIFORM_SHADOW_ATLAS, TEXTURE_UNIT_SHADOW_ATLAS);
+        setInt(UNIFORM_SHADOW_MAP_COMPARE, TEXTURE_UNIT_SHADOW_COMPARE);
+        setInt(UNIFORM_SHADOW_MOMENTS, TEXTURE_UNIT_SHADOW_MOMENTS);
+        setInt(UNIFORM_BLUR_SOURCE, TEXTURE_UNIT_BLUR_SOURCE);
+        setInt(UNIFORM_CLUSTER_LIGHTS, TEXTURE_UNIT_CLUSTER_LIGHTS);
+        setInt(UNIFORM_CLUSTER_RANGES, TEXTURE_UNIT_CLUSTER_RANGES);
+        setInt(UNIFORM_CLUSTER_INDICES, TEXTURE_UNIT_CLUSTER_INDICES);
+        setInt(UNIFORM_G_ALBEDO_SPECULAR, TEXTURE_UNIT_G_ALBEDO_SPECULAR);
+        setInt(UNIFORM_G_NORMAL, TEXTURE_UNIT_G_NORMAL);
+        setInt(UNIFORM_G_DEPTH, TEXTURE_UNIT_G_DEPTH);
+        // the depth shader renders the directional cascades unless told otherwise
+        setInt(UNIFORM_ATLAS_TILE, -1);
+        // every program linked from basic.vert decodes the octahedral normals of packed meshes
+        setInt(UNIFORM_PACKED_NORMALS, Mesh::packedVertices);
+
+        GLuint frameBlock = glGetUniformBlockIndex(this->shaderProgram, FRAME_UNIFORMS_BLOCK);
+        if (frameBlock != GL_INVALID_INDEX)
+            glUniformBlockBinding(this->shaderProgram, frameBlock, FRAME_UNIFORMS_BINDING);
+    }
+
+    GLint Shader::getUniform(const std::string& name) const
+    {
+        auto found = std::lower_bound(uniforms.begin(), uniforms.end(), name, [](const UniformInfo& uniform, const std::string& key) {
+            return uniform.name < key;
+        });
+        if (found == uniforms.end() || found->name != name)
+            return -1;
+        return found->location;
     }
 
     void Shader::useShaderProgram()
     {
-        glUseProgram(this->shaderProgram);
+        glState.useProgram(this->shaderProgram);
     }
 
 }
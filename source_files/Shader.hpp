@@ -2,15 +2,76 @@
 #define Shader_hpp
 
 #include <GL/glew.h>
+#include "glm/glm.hpp"
 
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <string>
+#include <vector>
 
 namespace gps {
 
+// Uniforms used by the renderer, resolved once per program at link time.
+// Per-frame values live in the FrameUniforms block instead.
+enum UniformSlot {
+    UNIFORM_MODEL,
+    UNIFORM_PACKED_NORMALS,
+    UNIFORM_DIFFUSE_TEXTURE,
+    UNIFORM_SPECULAR_TEXTURE,
+    UNIFORM_AMBIENT_TEXTURE,
+    UNIFORM_SHADOW_MAP,
+    UNIFORM_DEPTH_MAP,
+    UNIFORM_SKYBOX,
+    UNIFORM_TRANSFORMS,
+    UNIFORM_CASCADE,
+    UNIFORM_SHADOW_ATLAS,
+    UNIFORM_ATLAS_TILE,
+    UNIFORM_SHADOW_MAP_COMPARE,
+    UNIFORM_SHADOW_MOMENTS,
+    UNIFORM_BLUR_SOURCE,
+    UNIFORM_BLUR_VERTICAL,
+    UNIFORM_CLUSTER_LIGHTS,
+    UNIFORM_CLUSTER_RANGES,
+    UNIFORM_CLUSTER_INDICES,
+    UNIFORM_G_ALBEDO_SPECULAR,
+    UNIFORM_G_NORMAL,
+    UNIFORM_G_DEPTH,
+    UNIFORM_SLOT_COUNT
+};
+
+// Fixed texture units - the samplers are assigned once after linking
+enum TextureUnit {
+    TEXTURE_UNIT_DIFFUSE = 0,
+    TEXTURE_UNIT_SPECULAR = 1,
+    TEXTURE_UNIT_AMBIENT = 2,
+    TEXTURE_UNIT_SHADOW_MAP = 3,
+    TEXTURE_UNIT_TRANSFORMS = 4,
+    TEXTURE_UNIT_SHADOW_ATLAS = 5,
+    // the shadow map again, through a depth comparison sampler
+    TEXTURE_UNIT_SHADOW_COMPARE = 6,
+    TEXTURE_UNIT_SHADOW_MOMENTS = 7,
+    // input of the second moments blur pass
+    TEXTURE_UNIT_BLUR_SOURCE = 8,
+    // clustered lights, their cluster ranges and index list (LightClusters.hpp)
+    TEXTURE_UNIT_CLUSTER_LIGHTS = 9,
+    TEXTURE_UNIT_CLUSTER_RANGES = 10,
+    TEXTURE_UNIT_CLUSTER_INDICES = 11,
+    // G-buffer of the deferred path, read by its lighting pass
+    TEXTURE_UNIT_G_ALBEDO_SPECULAR = 12,
+    TEXTURE_UNIT_G_NORMAL = 13,
+    TEXTURE_UNIT_G_DEPTH = 14
+};
+
+// Active uniform reported by the driver
+struct UniformInfo {
+    std::string name;
+    GLint location;
+    GLenum type;
+    GLint size;
+};
+
 class Shader
 {
 public:
@@ -18,10 +79,36 @@ public:
     void loadShader(std::string vertexShaderFileName, std::string fragmentShaderFileName);
     void useShaderProgram();
 
+    // Location of an active uniform (-1 if the program does not use it).
+    // Looks the name up in the table - call it at init time and keep the result.
+    GLint getUniform(const std::string& name) const;
+
+    GLint getUniform(UniformSlot slot) const { return slotLocations[slot]; }
+
+    // Typed setters writing to this program whether it is bound or not, no string or driver lookups
+    void setInt(GLint location, GLint value) const { glProgramUniform1i(shaderProgram, location, value); }
+    void setFloat(GLint location, GLfloat value) const { glProgramUniform1f(shaderProgram, location, value); }
+    void setVec3(GLint location, const glm::vec3& value) const { glProgramUniform3fv(shaderProgram, location, 1, &value[0]); }
+    void setMat3(GLint location, const glm::mat3& value) const { glProgramUniformMatrix3fv(shaderProgram, location, 1, GL_FALSE, &value[0][0]); }
+    void setMat4(GLint location, const glm::mat4& value) const { glProgramUniformMatrix4fv(shaderProgram, location, 1, GL_FALSE, &value[0][0]); }
+
+    void setInt(UniformSlot slot, GLint value) const { setInt(slotLocations[slot], value); }
+    void setFloat(UniformSlot slot, GLfloat value) const { setFloat(slotLocations[slot], value); }
+    void setVec3(UniformSlot slot, const glm::vec3& value) const { setVec3(slotLocations[slot], value); }
+    void setMat3(UniformSlot slot, const glm::mat3& value) const { setMat3(slotLocations[slot], value); }
+    void setMat4(UniformSlot slot, const glm::mat4& value) const { setMat4(slotLocations[slot], value); }
+
 private:
+    // Active uniforms sorted by name
+    std::vector<UniformInfo> uniforms;
+    GLint slotLocations[UNIFORM_SLOT_COUNT];
+
     std::string readShaderFile(std::string fileName);
     void shaderCompileLog(GLuint shaderId);
     void shaderLinkLog(GLuint shaderProgramId);
+    // Fills the uniform table and slots, binds the samplers to their texture units
+    // and the FrameUniforms block to its binding point
+    void introspectUniforms();
 };
 
 }
@@ -0,0 +1,104 @@
+#include "ShadowFrustum.hpp"
+
+#include "glm/gtc/matrix_transform.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+namespace gps {
+
+    // weight of the logarithmic split, the rest is uniform
+    const float CASCADE_SPLIT_BLEND = 0.75f;
+
+    glm::mat4 directionalLightView(const glm::vec3& towardsLight)
+    {
+        glm::vec3 direction = glm::normalize(towardsLight);
+        glm::vec3 up = std::fabs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::lookAt(direction, glm::vec3(0.0f), up);
+    }
+
+    void cascadeSplits(float nearPlane, float farPlane, int count, float* splits)
+    {
+        for (int i = 1; i <= count; i++) {
+            float t = (float)i / (float)count;
+            float logarithmic = nearPlane * std::pow(farPlane / nearPlane, t);
+            float uniform = nearPlane + (farPlane - nearPlane) * t;
+            splits[i - 1] = CASCADE_SPLIT_BLEND * logarithmic + (1.0f - CASCADE_SPLIT_BLEND) * uniform;
+        }
+    }
+
+    glm::mat4 fitLightFrustum(const glm::mat4& lightView, const glm::mat4& cameraView, const glm::mat4& projection,
+                              float sliceNear, float sliceFar, const glm::vec3& sceneMin, const glm::vec3& sceneMax,
+                              unsigned int resolution)
+    {
+        // bounding sphere of the slice, centred on the view axis - its size does not depend on
+        // the camera orientation
+        float tanX = 1.0f / projection[0][0];
+        float tanY = 1.0f / projection[1][1];
+        float centreDistance = (sliceNear + sliceFar) * 0.5f;
+        float radius = 0.0f;
+        float distances[2] = { sliceNear, sliceFar };
+        for (int i = 0; i < 2; i++) {
+            glm::vec3 corner(tanX * distances[i], tanY * distances[i], distances[i] - centreDistance);
+            radius = std::max(radius, glm::length(corner));
+        }
+        // rounded up, float noise in the camera matrix must not resize the window
+        radius = std::ceil(radius * 64.0f) / 64.0f;
+
+        glm::vec4 centre = glm::inverse(cameraView) * glm::vec4(0.0f, 0.0f, -centreDistance, 1.0f);
+        glm::vec3 centreLight = glm::vec3(lightView * centre);
+
+        // scene box in light space
+        glm::vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for (int i = 0; i < 8; i++) {
+            glm::vec3 corner((i & 1) ? sceneMax.x : sceneMin.x, (i & 2) ? sceneMax.y : sceneMin.y,
+                             (i & 4) ? sceneMax.z : sceneMin.z);
+            glm::vec3 cornerLight = glm::vec3(lightView * glm::vec4(corner, 1.0f));
+            lo = glm::min(lo, cornerLight);
+            hi = glm::max(hi, cornerLight);
+        }
+
+        // no larger than the scene, plus a texel on each side for the snapping
+        float size = std::max(std::min(2.0f * radius, std::max(hi.x - lo.x, hi.y - lo.y)), 1e-3f);
+        float texel = size / (float)(resolution - 2);
+        float extent = texel * (float)resolution;
+
+        float windowMin[2];
+        for (int axis = 0; axis < 2; axis++) {
+            float start;
+            if (hi[axis] - lo[axis] <= size)
+                start = (lo[axis] + hi[axis] - size) * 0.5f;
+            else
+                start = std::min(std::max(centreLight[axis] - size * 0.5f, lo[axis]), hi[axis] - size);
+            windowMin[axis] = (std::floor(start / texel) - 1.0f) * texel;
+        }
+
+        // casters anywhere in the scene box between the light and the slice, the light looks down -z
+        float margin = (hi.z - lo.z) * 0.01f + 0.01f;
+        glm::mat4 lightProjection = glm::ortho(windowMin[0], windowMin[0] + extent, windowMin[1], windowMin[1] + extent,
+                                               -hi.z - margin, -lo.z + margin);
+        return lightProjection * lightView;
+    }
+
+    glm::mat4 spotLightSpace(const glm::vec3& position, const glm::vec3& direction, float coneAngle,
+                             float nearPlane, float farPlane)
+    {
+        glm::vec3 forward = glm::normalize(direction);
+        glm::vec3 up = std::fabs(forward.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        return glm::perspective(coneAngle, 1.0f, nearPlane, farPlane) * glm::lookAt(position, position + forward, up);
+    }
+
+    glm::mat4 cubeFaceLightSpace(const glm::vec3& position, int face, float nearPlane, float farPlane)
+    {
+        static const glm::vec3 FACE_DIRECTIONS[6] = {
+            glm::vec3(1.0f, 0.0f, 0.0f), glm::vec3(-1.0f, 0.0f, 0.0f),
+            glm::vec3(0.0f, 1.0f, 0.0f), glm::vec3(0.0f, -1.0f, 0.0f),
+            glm::vec3(0.0f, 0.0f, 1.0f), glm::vec3(0.0f, 0.0f, -1.0f)
+        };
+        glm::vec3 up = face == 2 || face == 3 ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        // 90 degrees, the six faces meet without gaps
+        return glm::perspective(glm::radians(90.0f), 1.0f, nearPlane, farPlane) *
+               glm::lookAt(position, position + FACE_DIRECTIONS[face], up);
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef ShadowFrustum_hpp
+#define ShadowFrustum_hpp
+
+#include "glm/glm.hpp"
+
+namespace gps {
+
+    // Light view looking along -towardsLight, the origin at the centre of the view
+    glm::mat4 directionalLightView(const glm::vec3& towardsLight);
+
+    // Camera distances ending each of count cascades in [nearPlane, farPlane], written to splits.
+    // Blend of the logarithmic and uniform split schemes.
+    void cascadeSplits(float nearPlane, float farPlane, int count, float* splits);
+
+    // Orthographic light space matrix covering the camera frustum slice [sliceNear, sliceFar],
+    // clipped to the scene box [sceneMin, sceneMax]. The depth range spans the whole scene box,
+    // so casters outside the camera view still reach the slice.
+    // The window keeps the size of the slice's bounding sphere and moves in whole texels of a
+    // resolution x resolution map, so shadow edges do not shimmer while the camera turns or moves.
+    glm::mat4 fitLightFrustum(const glm::mat4& lightView, const glm::mat4& cameraView, const glm::mat4& projection,
+                              float sliceNear, float sliceFar, const glm::vec3& sceneMin, const glm::vec3& sceneMax,
+                              unsigned int resolution);
+
+    // Perspective light space matrix of a spot light at position shining along direction,
+    // coneAngle the full opening in radians
+    glm::mat4 spotLightSpace(const glm::vec3& position, const glm::vec3& direction, float coneAngle,
+                             float nearPlane, float farPlane);
+
+    // Light space matrix of one face of a point light's shadow cube, faces ordered +x, -x, +y, -y, +z, -z
+    glm::mat4 cubeFaceLightSpace(const glm::vec3& position, int face, float nearPlane, float farPlane);
+}
+
+#endif /* ShadowFrustum_hpp */
@@ -0,0 +1,147 @@
+#include "TransformBuffer.hpp"
+
+#include <iostream>
+
+namespace gps {
+
+    void TransformBuffer::create(size_t capacity)
+    {
+        this->capacity = capacity;
+        allocateStorage();
+    }
+
+    void TransformBuffer::allocateStorage()
+    {
+        GLint maxTexels = 0;
+        glGetIntegerv(GL_MAX_TEXTURE_BUFFER_SIZE, &maxTexels);
+        if ((GLint64)(capacity * RING_SIZE * TEXELS_PER_TRANSFORM) > maxTexels)
+            std::cout << "Transform buffer needs " << capacity * RING_SIZE * TEXELS_PER_TRANSFORM
+                << " texels, the driver allows " << maxTexels << std::endl;
+
+        GLsizeiptr size = (GLsizeiptr)(capacity * RING_SIZE * sizeof(GpuTransform));
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+        if (GLEW_ARB_buffer_storage) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_TEXTURE_BUFFER, size, NULL, flags);
+            persistent = (GpuTransform*)glMapBufferRange(GL_TEXTURE_BUFFER, 0, size, flags);
+        }
+        else {
+            glBufferData(GL_TEXTURE_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+            persistent = nullptr;
+        }
+
+        glGenTextures(1, &bufferTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, bufferTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, buffer);
+        glBindTexture(GL_TEXTURE_BUFFER, 0);
+        glBindBuffer(GL_TEXTURE_BUFFER, 0);
+
+        // nothing has been written to the new storage yet
+        for (size_t i = 0; i < objects.size(); i++)
+            objects[i].pendingWrites = RING_SIZE;
+    }
+
+    void TransformBuffer::releaseStorage()
+    {
+        // only happens when the scene grows, the GPU has to let go of every region
+        glFinish();
+        for (int i = 0; i < RING_SIZE; i++) {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (persistent) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glUnmapBuffer(GL_TEXTURE_BUFFER);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+        glDeleteTextures(1, &bufferTexture);
+        glDeleteBuffers(1, &buffer);
+        persistent = nullptr;
+    }
+
+    void TransformBuffer::beginFrame(size_t slotCount)
+    {
+        writtenLastFrame = written;
+        written = 0;
+        objectCount = 0;
+        nextSlot = 0;
+
+        if (slotCount > capacity) {
+            releaseStorage();
+            while (capacity < slotCount)
+                capacity *= 2;
+            allocateStorage();
+        }
+
+        region = (region + 1) % RING_SIZE;
+        if (fences[region]) {
+            // three frames back - this only blocks if the GPU is that far behind
+            if (glClientWaitSync(fences[region], 0, 0) == GL_TIMEOUT_EXPIRED) {
+                fenceStalls++;
+                glClientWaitSync(fences[region], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+            }
+            glDeleteSync(fences[region]);
+            fences[region] = 0;
+        }
+
+        if (persistent) {
+            mapped = persistent + region * capacity;
+        }
+        else {
+            // the fence already covers the region, no need for the driver to synchronize
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            mapped = (GpuTransform*)glMapBufferRange(GL_TEXTURE_BUFFER,
+                (GLintptr)(region * capacity * sizeof(GpuTransform)), (GLsizeiptr)(capacity * sizeof(GpuTransform)),
+                GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+    }
+
+    uint32_t TransformBuffer::allocate(uint32_t count, bool modified, bool& changed)
+    {
+        if (objectCount == objects.size())
+            objects.push_back({ nextSlot, count, RING_SIZE });
+
+        Object& object = objects[objectCount++];
+        if (modified || object.firstSlot != nextSlot || object.count != count) {
+            object.firstSlot = nextSlot;
+            object.count = count;
+            object.pendingWrites = RING_SIZE;
+        }
+
+        changed = object.pendingWrites > 0;
+        if (changed)
+            object.pendingWrites--;
+
+        nextSlot += count;
+        return (uint32_t)(region * capacity) + object.firstSlot;
+    }
+
+    void TransformBuffer::write(uint32_t slot, const glm::mat4& model, const glm::mat3& normalMatrix)
+    {
+        GpuTransform& transform = mapped[slot - region * capacity];
+        for (int i = 0; i < 4; i++)
+            transform.model[i] = model[i];
+        for (int i = 0; i < 3; i++)
+            transform.normalMatrix[i] = glm::vec4(normalMatrix[i], 0.0f);
+        written++;
+    }
+
+    void TransformBuffer::finishWrites()
+    {
+        // the coherent persistent mapping needs nothing, the fallback maps one region per frame
+        if (!persistent && mapped) {
+            glBindBuffer(GL_TEXTURE_BUFFER, buffer);
+            glUnmapBuffer(GL_TEXTURE_BUFFER);
+            glBindBuffer(GL_TEXTURE_BUFFER, 0);
+        }
+        mapped = nullptr;
+    }
+
+    void TransformBuffer::endFrame()
+    {
+        fences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+}
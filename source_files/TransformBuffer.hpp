@@ -0,0 +1,88 @@
+#ifndef TransformBuffer_hpp
+#define TransformBuffer_hpp
+
+#include <GL/glew.h>
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace gps {
+
+    // Per-draw transform as the shaders fetch it from the "transforms" buffer texture
+    struct GpuTransform {
+        // model matrix with the mesh dequantize folded in, by column
+        glm::vec4 model[4];
+        // inverse transpose of the object's model matrix (no dequantize), by column
+        glm::vec4 normalMatrix[3];
+    };
+
+    const GLint TEXELS_PER_TRANSFORM = sizeof(GpuTransform) / sizeof(glm::vec4);
+
+    // Ring of RING_SIZE transform regions in one buffer texture, one region per frame in flight.
+    // The next frame's region is reused only once the GPU fence of the frame that last used it
+    // has passed. Objects are matched to the previous frames by submission order and only
+    // rewritten while the caller reported a change in the last RING_SIZE frames.
+    class TransformBuffer
+    {
+    public:
+        static const int RING_SIZE = 3;
+
+        // Allocates room for capacity transforms per region - needs the GL context
+        void create(size_t capacity);
+
+        // Moves to the next region, growing it to slotCount transforms if needed
+        void beginFrame(size_t slotCount);
+
+        // Reserves count consecutive slots for an object, in submission order, modified telling
+        // whether its matrices changed since last frame. Returns the first one (absolute, as the
+        // shaders index it); changed tells whether the slots have to be written this frame.
+        uint32_t allocate(uint32_t count, bool modified, bool& changed);
+
+        void write(uint32_t slot, const glm::mat4& model, const glm::mat3& normalMatrix);
+
+        // Makes the frame's writes visible, call before the first draw
+        void finishWrites();
+
+        // Fences the region once the frame's draws are issued
+        void endFrame();
+
+        GLuint texture() const { return bufferTexture; }
+
+        // Transforms written last frame, times the CPU had to wait for a fence
+        size_t lastFrameWritten() const { return writtenLastFrame; }
+        size_t stalls() const { return fenceStalls; }
+
+    private:
+        struct Object {
+            uint32_t firstSlot;
+            uint32_t count;
+            // regions still holding an older copy
+            int pendingWrites;
+        };
+
+        GLuint buffer = 0;
+        GLuint bufferTexture = 0;
+        size_t capacity = 0;
+        // persistently mapped whole buffer, null when the driver lacks ARB_buffer_storage
+        GpuTransform* persistent = nullptr;
+        // this frame's region
+        GpuTransform* mapped = nullptr;
+        int region = 0;
+        GLsync fences[RING_SIZE] = {};
+
+        std::vector<Object> objects;
+        size_t objectCount = 0;
+        uint32_t nextSlot = 0;
+
+        size_t written = 0;
+        size_t writtenLastFrame = 0;
+        size_t fenceStalls = 0;
+
+        void allocateStorage();
+        void releaseStorage();
+    };
+}
+
+#endif /* TransformBuffer_hpp */
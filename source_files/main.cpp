@@ -12,17 +12,35 @@
 #include "Camera.hpp"
 #include "Model3D.hpp"
 #include "SkyBox.hpp"
-
+#include "Benchmark.hpp"
+#include "Culling.hpp"
+#include "GLStateCache.hpp"
+#include "RenderQueue.hpp"
+#include "FrameUniforms.hpp"
+#include "TransformBuffer.hpp"
+#include "GeometryPool.hpp"
+#include "EntityStore.hpp"
+#include "ShadowFrustum.hpp"
+#include "GpuTimer.hpp"
+#include "LightClusters.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
 #include <iostream>
+#include <string>
+#include <thread>
 
 // window
 gps::Window myWindow;
 
 // matrices
-glm::mat4 model;
 glm::mat4 view;
 glm::mat4 projection;
-glm::mat3 normalMatrix;
 glm::mat4 lightRotation;
 
 // light parameters
@@ -38,16 +56,6 @@ glm::vec3 night;
 
 // shader uniform locations
 GLuint alphaLoc;
-GLuint modelLoc;
-GLuint viewLoc;
-GLuint projectionLoc;
-GLuint normalMatrixLoc;
-GLuint lightDirLoc;
-GLuint spotLightDirLoc;
-GLuint lightColorLoc;
-GLuint pointLightPosLoc;
-GLuint spotLightPosLoc;
-GLuint nightLoc;
 
 // camera
 gps::Camera myCamera(
@@ -113,15 +121,165 @@ gps::Model3D balloon;
 gps::Model3D screenQuad;
 gps::Model3D movingPlane;
 
+// model file to load into a Model3D
+struct ModelSource {
+	gps::Model3D* model;
+	const char* fileName;
+};
+
+// parse models on all cores, only the GL uploads stay on the main thread
+bool parallelModelLoading = true;
+
+// scene objects, their world matrices only change with angle and the animations
+gps::EntityStore scene;
+// every copy (--stress) of the animated objects
+std::vector<gps::EntityStore::Entity> movingPlaneEntities;
+std::vector<gps::EntityStore::Entity> balloonEntities;
+// transform slot of the first mesh of each scene run
+std::vector<uint32_t> runTransforms;
+// level of detail of every mesh of every run, picked by the main pass and kept for the
+// hysteresis; the shadow pass draws the same levels. runLodFirst[i] is run i's first entry
+std::vector<int> runLods;
+std::vector<size_t> runLodFirst;
+// entities whose world matrix was recomputed last frame
+size_t sceneUpdates = 0;
+
+// one box per scene run
+gps::BoundsBatch frameBounds;
+std::vector<unsigned char> frameVisible;
+// meshes of the visible objects, sorted before drawing
+gps::RenderQueue renderQueue;
+
+// per-frame shader constants
+gps::FrameUniforms frameUniforms;
+gps::FrameUniformBuffer frameUniformBuffer;
+
+// per-mesh transforms, written once per frame for both passes
+gps::TransformBuffer transformBuffer;
+
+// pooled geometry: indirect commands of the current pass and their transform slots
+std::vector<gps::DrawElementsIndirectCommand> drawCommands;
+std::vector<GLuint> drawTransforms;
+
+// copies of the scene added around the room (--stress), to load the draw submission
+unsigned int stressCopies = 0;
+
+// objects culled and draws issued in the last frame, summed over the draws of a pass
+struct PassStats {
+	size_t objects;
+	size_t culled;
+	size_t meshes;
+	size_t drawCalls;
+};
+
+PassStats shadowPassStats;
+PassStats mainPassStats;
+
+// culling, draw and GL state statistics, printed once per second - toggled with the O key
+bool showFrameStats = false;
+double lastFrameReport = 0.0;
+// CPU time spent in renderScene since the last report
+double cpuFrameTime = 0.0;
+size_t cpuFrameCount = 0;
 
 GLfloat angle = 0;
 GLfloat anglePlane = 0;
 GLfloat moveForward = 0;
 GLfloat lightAngle;
 
-GLuint shadowMapFBO;
+// directional shadow cascades (--cascades), one layer of depthMapTexture and one FBO each
+int shadowCascades = 2;
+GLuint shadowMapFBO[gps::MAX_SHADOW_CASCADES];
 GLuint depthMapTexture;
 
+// depth of the static casters alone, copied into the shadow map every frame; a cascade is
+// re-rendered only when its light space matrix changes or a static caster moves
+GLuint staticShadowFBO[gps::MAX_SHADOW_CASCADES];
+GLuint staticShadowTexture;
+bool staticShadowValid = false;
+glm::mat4 staticShadowLightSpace[gps::MAX_SHADOW_CASCADES];
+// cascades drawn since the last report, and how many of them re-rendered the static casters
+size_t shadowFrames = 0;
+size_t staticShadowRenders = 0;
+
+// lamp shadows at night: one atlas tile for the spot light and one per cube face of the point light
+GLuint shadowAtlasFBO;
+GLuint shadowAtlasTexture;
+// static casters of every tile, copied into the atlas when a tile is composited again
+GLuint staticAtlasFBO;
+GLuint staticAtlasTexture;
+bool lampShadowValid = false;
+glm::mat4 staticAtlasLightSpace[gps::SHADOW_ATLAS_TILES];
+// moving casters inside each tile's frustum at its last composite
+std::vector<unsigned char> lampCasters[gps::SHADOW_ATLAS_TILES];
+std::vector<unsigned char> lampVisible;
+// tiles checked since the last report, how many were composited and how many re-rendered the static casters
+size_t lampTileFrames = 0;
+size_t lampTileComposites = 0;
+size_t lampStaticRenders = 0;
+
+// filtering of the directional shadows (--shadow-filter) - cycled with the R key
+gps::ShadowFilter shadowFilter = gps::SHADOW_FILTER_HARD;
+const char* SHADOW_FILTER_NAMES[gps::SHADOW_FILTER_COUNT] = { "hard", "pcf", "evsm" };
+// depth comparison over depthMapTexture, bound to TEXTURE_UNIT_SHADOW_COMPARE
+GLuint shadowCompareSampler;
+// exponential variance moments of each cascade with their mip chain, and the horizontal blur target
+GLuint momentsFBO[gps::MAX_SHADOW_CASCADES];
+GLuint momentsTexture;
+GLuint blurFBO;
+GLuint blurTexture;
+// the moments are filtered only when the shadow map changed
+bool momentsValid = false;
+size_t momentsUpdates = 0;
+
+// GPU time of the shadow maps, the moments filtering and the main pass
+gps::GpuTimer shadowMapTimer;
+gps::GpuTimer shadowFilterTimer;
+gps::GpuTimer mainPassTimer;
+
+// deferred shading (--deferred, TAB key): the geometry pass writes albedo, specular, normal and
+// depth to the G-buffer and one full-screen pass lights every pixel, instead of the forward main pass
+bool deferredShading = false;
+GLuint gBufferFBO;
+GLuint gAlbedoSpecularTexture;
+GLuint gNormalTexture;
+GLuint gDepthTexture;
+// follows the window, reallocated when it is resized
+int gBufferWidth = 0;
+int gBufferHeight = 0;
+gps::GpuTimer geometryPassTimer;
+gps::GpuTimer lightingPassTimer;
+
+// small unshadowed point lights (--lights n) - string lights, night lights and glowing toys
+// spread through the scene on the first frame and binned into view space clusters
+const size_t MAX_CLUSTER_LIGHTS = 1024;
+size_t clusterLightCount = 0;
+std::vector<gps::ClusterLight> clusterLights;
+// where each light bobs around, before the scene rotation
+std::vector<glm::vec3> clusterLightAnchors;
+float clusterLightBob = 0.0f;
+gps::LightClusters lightClusters;
+// false to loop over every clustered light in each fragment (--no-clusters)
+bool clusteredLighting = true;
+// CPU time spent binning the lights since the last report
+double clusterBinTime = 0.0;
+size_t clusterBinFrames = 0;
+
+// --bench-lights: main pass GPU time with 2, 4 ... MAX_CLUSTER_LIGHTS lights, each count
+// clustered and then looping over every light - the geometry and lighting passes with --deferred
+bool benchmarkLights = false;
+int benchmarkStep = 0;
+int benchmarkFrame = 0;
+const int BENCHMARK_WARMUP_FRAMES = 30;
+const int BENCHMARK_FRAMES = 120;
+
+// scene runs drawn by a drawObjects call
+enum PassCasters {
+	CASTERS_ALL,
+	CASTERS_STATIC,
+	CASTERS_DYNAMIC
+};
+
 bool showDepthMap;
 
 // shaders
@@ -129,11 +287,26 @@ gps::Shader myBasicShader;
 gps::Shader skyboxShader;
 gps::Shader screenQuadShader;
 gps::Shader depthMapShader;
+gps::Shader evsmBlurShader;
+gps::Shader gBufferShader;
+gps::Shader deferredLightingShader;
 
 gps::SkyBox mySkyBox;
 
-const unsigned int SHADOW_WIDTH = 2048;
-const unsigned int SHADOW_HEIGHT = 2048;
+// the light frusta are fitted to the view, a smaller map keeps the texel density
+const unsigned int SHADOW_WIDTH = 1024;
+const unsigned int SHADOW_HEIGHT = 1024;
+
+// lamp shadow atlas, columns and rows as in lighting.glsl
+const int ATLAS_COLUMNS = 4;
+const int ATLAS_ROWS = 2;
+const unsigned int ATLAS_TILE_SIZE = 512;
+// depth range of the lamp shadows, the lamps only light the room around them
+const float LAMP_NEAR = 0.02f;
+const float LAMP_FAR = 6.0f;
+
+const float CAMERA_NEAR = 0.1f;
+const float CAMERA_FAR = 20.0f;
 
 float lastX = myWindow.getWindowDimensions().width;
 float lastY = myWindow.getWindowDimensions().height;
@@ -181,7 +354,7 @@ GLenum glCheckError_(const char* file, int line)
 void windowResizeCallback(GLFWwindow* window, int width, int height) {
 	fprintf(stdout, "Window resized! New width: %d , and height: %d\n", width, height);
 
-	glViewport(0, 0, width, height);
+	gps::glState.viewport(0, 0, width, height);
 }
 
 void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int mode) {
@@ -200,6 +373,26 @@ void keyboardCallback(GLFWwindow* window, int key, int scancode, int action, int
 
 	if (key == GLFW_KEY_C && action == GLFW_PRESS)
 		showDepthMap = !showDepthMap;
+
+	if (key == GLFW_KEY_O && action == GLFW_PRESS)
+		showFrameStats = !showFrameStats;
+
+	if (key == GLFW_KEY_R && action == GLFW_PRESS) {
+		shadowFilter = (gps::ShadowFilter)((shadowFilter + 1) % gps::SHADOW_FILTER_COUNT);
+		std::cout << "shadow filter: " << SHADOW_FILTER_NAMES[shadowFilter] << std::endl;
+		// the timings of the report cover one filter
+		shadowMapTimer.reset();
+		shadowFilterTimer.reset();
+		mainPassTimer.reset();
+	}
+
+	if (key == GLFW_KEY_TAB && action == GLFW_PRESS) {
+		deferredShading = !deferredShading;
+		std::cout << "shading: " << (deferredShading ? "deferred" : "forward") << std::endl;
+		mainPassTimer.reset();
+		geometryPassTimer.reset();
+		lightingPassTimer.reset();
+	}
 }
 
 void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
@@ -211,10 +404,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 	else if (xpos > lastX)
 	{
@@ -223,10 +412,6 @@ void mouseCallback(GLFWwindow* window, double xpos, double ypos) {
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 	else if (xpos == lastX)
 	{
@@ -283,87 +468,50 @@ void processMovement() {
 		myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_S] || scrollBackward) {
 		myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_A] || mouseMotionLeft) {
 		myCamera.move(gps::MOVE_LEFT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_D] || mouseMotionRight) {
 		myCamera.move(gps::MOVE_RIGHT, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_T]) {
 		myCamera.move(gps::MOVE_UP, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_G]) {
 		myCamera.move(gps::MOVE_DOWN, cameraSpeed);
 		//update view matrix
 		view = myCamera.getViewMatrix();
-		myBasicShader.useShaderProgram();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-		// compute normal matrix
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_Q] || pressedLeftButton) {
 		angle -= 1.0f;
-		// update model matrix for teapot
-		model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-		// update normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_E] || pressedRightButton) {
 		angle += 1.0f;
-		// update model matrix for teapot
-		model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-		// update normal matrix for teapot
-		normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 	}
 
 	if (pressedKeys[GLFW_KEY_X]) {
-
-		myBasicShader.useShaderProgram();
-
 		night.x = !night.x;
 		night.y = !night.y;
 		night.z = !night.z;
-
-		glUniform3fv(glGetUniformLocation(myBasicShader.shaderProgram, "night"), 1, glm::value_ptr(night));
 	}
 
 	if (pressedKeys[GLFW_KEY_Z] && stopMoving == false) {
@@ -447,10 +595,10 @@ void setWindowCallbacks() {
 
 void initOpenGLState() {
 	glClearColor(0.7f, 0.7f, 0.7f, 1.0f);
-	glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+	gps::glState.viewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
 	glEnable(GL_FRAMEBUFFER_SRGB);
-	glEnable(GL_DEPTH_TEST); // enable depth-testing
-	glDepthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
+	gps::glState.depthTest(true); // enable depth-testing
+	gps::glState.depthFunc(GL_LESS); // depth-testing interprets a smaller value as "closer"
 	glEnable(GL_CULL_FACE); // cull face
 	glCullFace(GL_BACK); // cull back face
 	glFrontFace(GL_CCW); // GL_CCW for counter clock-wise
@@ -458,34 +606,82 @@ void initOpenGLState() {
 
 void initModels() {
 
-	screenQuad.LoadModel("quad/quad.obj");
-	room.LoadModel("models/room/Room/Sketchfab_2020_02_08_20_59_54.obj");
-	movingPlane.LoadModel("models/woodenPlane/Wooden_Plane.obj");
-	rug.LoadModel("models/rug/rug.obj");
-	numberedDice.LoadModel("models/numberedDice/Dice_Set/Dice_Set/DiceSet.obj");
-	bike.LoadModel("models/smallBike/Wooden_bicycle.obj");
-	mug.LoadModel("models/mug/Break.obj");
-	pony.LoadModel("models/pony/Pony.obj");
-	ponyHouse.LoadModel("models/ponyHouse/Sugarcube_Corner.obj");
-	fox.LoadModel("models/toyFox/obj/obj/obj.obj");
-	sled.LoadModel("models/sled/SledNew_obj/SledNew.obj");
-	dollHouse.LoadModel("models/dollHouse/10587_Doll_House_v3_L2.obj");
-	racket.LoadModel("models/racket/10540_Tennis_racket_V2_L3.obj");
-	tennisBall.LoadModel("models/tennisball/10539_tennis_ball_L3.obj");
-	soccerBall.LoadModel("models/soccer/Sketchfab_2020_08_23_19_50_55.obj");
-	barbieDoll.LoadModel("models/doll/10578_barbiedoll_v1_L3.obj");
-	toyPlane.LoadModel("models/planeToy/ToyPlane_OBJ/ToyPlane/ToyPlane.obj");
-	dogToy.LoadModel("models/stuffedToy/11706_stuffed_animal_L2.obj");
-	crayons.LoadModel("models/crayons/11676_Crayons_v1_L3.obj");
-	catToy.LoadModel("models/catToy/20430_Cat_v1_NEW.obj");
-	paperDoll.LoadModel("models/paperDoll/11679_doll_v3_L3.obj");
-	legoFigurine.LoadModel("models/legoMiniFigurine/lego.obj");
-	truckToy.LoadModel("models/truckToy/Leksaksbil.obj");
-	balloon.LoadModel("models/balloon/smeerws_2018-02-16_12-52-58.obj");
-	shelf.LoadModel("models/shelf/shelf/shelf.obj");
-	picture.LoadModel("models/picture/dog.obj");
-	frame.LoadModel("models/largeFrame/frame.obj");
-	books.LoadModel("models/book/books.obj");
+	std::vector<ModelSource> sources = {
+		{ &screenQuad, "quad/quad.obj" },
+		{ &room, "models/room/Room/Sketchfab_2020_02_08_20_59_54.obj" },
+		{ &movingPlane, "models/woodenPlane/Wooden_Plane.obj" },
+		{ &rug, "models/rug/rug.obj" },
+		{ &numberedDice, "models/numberedDice/Dice_Set/Dice_Set/DiceSet.obj" },
+		{ &bike, "models/smallBike/Wooden_bicycle.obj" },
+		{ &mug, "models/mug/Break.obj" },
+		{ &pony, "models/pony/Pony.obj" },
+		{ &ponyHouse, "models/ponyHouse/Sugarcube_Corner.obj" },
+		{ &fox, "models/toyFox/obj/obj/obj.obj" },
+		{ &sled, "models/sled/SledNew_obj/SledNew.obj" },
+		{ &dollHouse, "models/dollHouse/10587_Doll_House_v3_L2.obj" },
+		{ &racket, "models/racket/10540_Tennis_racket_V2_L3.obj" },
+		{ &tennisBall, "models/tennisball/10539_tennis_ball_L3.obj" },
+		{ &soccerBall, "models/soccer/Sketchfab_2020_08_23_19_50_55.obj" },
+		{ &barbieDoll, "models/doll/10578_barbiedoll_v1_L3.obj" },
+		{ &toyPlane, "models/planeToy/ToyPlane_OBJ/ToyPlane/ToyPlane.obj" },
+		{ &dogToy, "models/stuffedToy/11706_stuffed_animal_L2.obj" },
+		{ &crayons, "models/crayons/11676_Crayons_v1_L3.obj" },
+		{ &catToy, "models/catToy/20430_Cat_v1_NEW.obj" },
+		{ &paperDoll, "models/paperDoll/11679_doll_v3_L3.obj" },
+		{ &legoFigurine, "models/legoMiniFigurine/lego.obj" },
+		{ &truckToy, "models/truckToy/Leksaksbil.obj" },
+		{ &balloon, "models/balloon/smeerws_2018-02-16_12-52-58.obj" },
+		{ &shelf, "models/shelf/shelf/shelf.obj" },
+		{ &picture, "models/picture/dog.obj" },
+		{ &frame, "models/largeFrame/frame.obj" },
+		{ &books, "models/book/books.obj" },
+	};
+
+	auto loadStart = std::chrono::steady_clock::now();
+
+	// parse the .obj files and decode the textures - no GL calls here
+	if (parallelModelLoading) {
+		unsigned int workerCount = std::max(1u, std::thread::hardware_concurrency());
+		workerCount = std::min(workerCount, (unsigned int)sources.size());
+		std::atomic<size_t> nextSource(0);
+		// the pool already keeps every core busy, one parse thread per file
+		unsigned int parseThreads = gps::Model3D::parseThreads;
+		gps::Model3D::parseThreads = 1;
+
+		std::vector<std::thread> workers;
+		for (unsigned int i = 0; i < workerCount; i++) {
+			workers.emplace_back([&sources, &nextSource]() {
+				size_t current;
+				while ((current = nextSource++) < sources.size()) {
+					sources[current].model->LoadModelData(sources[current].fileName);
+				}
+			});
+		}
+		for (size_t i = 0; i < workers.size(); i++) {
+			workers[i].join();
+		}
+		gps::Model3D::parseThreads = parseThreads;
+	}
+	else {
+		for (size_t i = 0; i < sources.size(); i++) {
+			sources[i].model->LoadModelData(sources[i].fileName);
+		}
+	}
+
+	auto parseEnd = std::chrono::steady_clock::now();
+
+	// buffers and textures have to be created on the context thread
+	for (size_t i = 0; i < sources.size(); i++) {
+		sources[i].model->UploadModel();
+	}
+	// the meshes only appended their geometry to the shared buffers
+	if (gps::Mesh::pooledGeometry)
+		gps::geometryPool.upload();
+
+	auto loadEnd = std::chrono::steady_clock::now();
+	std::cout << "Models loaded in " << std::chrono::duration<double, std::milli>(loadEnd - loadStart).count() << " ms ("
+		<< std::chrono::duration<double, std::milli>(parseEnd - loadStart).count() << " ms parsing"
+		<< (parallelModelLoading ? ", parallel" : ", serial") << ")" << std::endl;
 }
 
 void initShaders() {
@@ -501,864 +697,537 @@ void initShaders() {
 
 	screenQuadShader.loadShader("shaders/screenQuad.vert", "shaders/screenQuad.frag");
 	screenQuadShader.useShaderProgram();
+
+	evsmBlurShader.loadShader("shaders/screenQuad.vert", "shaders/evsmBlur.frag");
+
+	gBufferShader.loadShader("shaders/basic.vert", "shaders/gbuffer.frag");
+	deferredLightingShader.loadShader("shaders/screenQuad.vert", "shaders/deferredLighting.frag");
 }
 
 
 void initUniforms() {
 	myBasicShader.useShaderProgram();
 
-	// create model matrix for teapot
-	model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-	modelLoc = glGetUniformLocation(myBasicShader.shaderProgram, "model");
-
 	// get view matrix for current camera
 	view = myCamera.getViewMatrix();
-	viewLoc = glGetUniformLocation(myBasicShader.shaderProgram, "view");
-	// send view matrix to shader
-	glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-	// compute normal matrix for teapot
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-	normalMatrixLoc = glGetUniformLocation(myBasicShader.shaderProgram, "normalMatrix");
 
 	// create projection matrix
 	projection = glm::perspective(glm::radians(45.0f),
 		(float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-		0.1f, 20.0f);
-	projectionLoc = glGetUniformLocation(myBasicShader.shaderProgram, "projection");
-	// send projection matrix to shader
-	glUniformMatrix4fv(projectionLoc, 1, GL_FALSE, glm::value_ptr(projection));
+		CAMERA_NEAR, CAMERA_FAR);
 
 	//set the light direction (direction towards the light)
-
 	lightDir = glm::vec3(0.0f, 1.0f, 3.0f);
-	lightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightDir");
-	// send light dir to shader
-	glUniform3fv(lightDirLoc, 1, glm::value_ptr(lightDir));
+	lightRotation = glm::mat4(1.0f);
 
 	spotLightDir = glm::vec3(0.0f, -10.0f, 0.0f);
-	spotLightDirLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightDir");
-	// send light dir to shader
-	glUniform3fv(spotLightDirLoc, 1, glm::value_ptr(spotLightDir));
 
 	pointLightPos = glm::vec3(-0.919999f, 0.45f, -0.54f);
 	pointLightPosV = glm::vec4(pointLightPos, 1.0f);
-	pointLightPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightPosEye");
-	glm::vec4 ptr = glm::mat4(view) * pointLightPosV;
-	glUniform3fv(pointLightPosLoc, 1, glm::value_ptr(glm::vec3(ptr)));
 
 	spotLightPos = glm::vec3(0.62f, 1.09f, 1.12f);
 	spotLightPosV = glm::vec4(spotLightPos, 1.0f);
-	spotLightPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightPosEye");
-	glm::vec4 ptr1 = glm::mat4(view) * spotLightPosV;
-	glUniform3fv(spotLightPosLoc, 1, glm::value_ptr(glm::vec3(ptr1)));
 
 	//set light color
 	lightColor = glm::vec3(1.0f, 1.0f, 1.0f); //white light
-	lightColorLoc = glGetUniformLocation(myBasicShader.shaderProgram, "lightColor");
-	// send light color to shader
-	glUniform3fv(lightColorLoc, 1, glm::value_ptr(lightColor));
 
 	night = glm::vec3(0.0f, 0.0f, 0.0f);
-	nightLoc = glGetUniformLocation(myBasicShader.shaderProgram, "night");
-	// send light color to shader
-	glUniform3fv(nightLoc, 1, glm::value_ptr(night));
 
+	// the per-frame values above reach the shaders through the FrameUniforms block
+	frameUniformBuffer.create();
+	// grows if the scene needs more
+	transformBuffer.create(1024);
 }
 
 void getPointLightPos() {
 
-	myBasicShader.useShaderProgram();
-
 	pointLightPos = glm::vec3(-0.919999f, 0.45f, -0.54f);   // floor lamp
 
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	pointLightPos = glm::vec3(model * glm::vec4(pointLightPos, 1.0f));
+	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+	pointLightPos = glm::vec3(rotation * glm::vec4(pointLightPos, 1.0f));
 
 	pointLightPosV = glm::vec4(pointLightPos, 1.0f);
-
-	pointLightPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "pointLightPosEye");
-	glm::vec4 ptr = glm::mat4(view) * pointLightPosV;
-	glUniform3fv(pointLightPosLoc, 1, glm::value_ptr(glm::vec3(ptr)));
-
 }
 
 void getSpotLightPos() {
 
-	myBasicShader.useShaderProgram();
-
 	spotLightPos = glm::vec3(0.62f, 1.09f, 1.12f);    // desk lamp
 
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	spotLightPos = glm::vec3(model * glm::vec4(spotLightPos, 1.0f));
+	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+	spotLightPos = glm::vec3(rotation * glm::vec4(spotLightPos, 1.0f));
 
 	spotLightPosV = glm::vec4(spotLightPos, 1.0f);
+}
+// depth texture array of the shadow map size, one layer per cascade, and an FBO rendering into each layer
+void createShadowTarget(GLuint* fbos, GLuint& texture) {
+	//create depth texture for FBO
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT,
+		SHADOW_WIDTH, SHADOW_HEIGHT, shadowCascades, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
-	spotLightPosLoc = glGetUniformLocation(myBasicShader.shaderProgram, "spotLightPosEye");
-	glm::vec4 ptr = glm::mat4(view) * spotLightPosV;
-	glUniform3fv(spotLightPosLoc, 1, glm::value_ptr(glm::vec3(ptr)));
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+
+	//generate FBO IDs and attach the layers
+	glGenFramebuffers(shadowCascades, fbos);
+	for (int i = 0; i < shadowCascades; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, fbos[i]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, texture, 0, i);
+
+		glDrawBuffer(GL_NONE);
+		glReadBuffer(GL_NONE);
+	}
 
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
-void initFBO() {
-	//TODO - Create the FBO, the depth texture and attach the depth texture to the FBO
-
-	//generate FBO ID
-	glGenFramebuffers(1, &shadowMapFBO);
 
-	//create depth texture for FBO
-	glGenTextures(1, &depthMapTexture);
-	glBindTexture(GL_TEXTURE_2D, depthMapTexture);
+// depth texture holding the lamp shadow tiles, and an FBO rendering into it
+void createAtlasTarget(GLuint& fbo, GLuint& texture) {
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT,
-		SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+		ATLAS_COLUMNS * ATLAS_TILE_SIZE, ATLAS_ROWS * ATLAS_TILE_SIZE, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
-	glTexParameterfv(GL_TEXTURE_2D, GL_TEXTURE_BORDER_COLOR, borderColor);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
-
-	//attach texture to FBO
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, depthMapTexture, 0);
-
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, texture, 0);
 	glDrawBuffer(GL_NONE);
 	glReadBuffer(GL_NONE);
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
-glm::mat4 computeLightSpaceTrMatrix() {
-	//TODO - Return the light-space transformation matrix
-
-	glm::mat4 lightView = glm::lookAt(glm::vec3(lightRotation * (glm::vec4(lightDir, 1.0f))), glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-
-	const GLfloat near_plane = 0.1f, far_plane = 10.0f;
-	glm::mat4 lightProjection = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, near_plane, far_plane);
-
-	glm::mat4 lightSpaceTrMatrix = lightProjection * lightView;
-	return lightSpaceTrMatrix;
-}
-
-
-void renderRoom(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.18f, -0.38f, -0.1f));
-
-	model = glm::scale(model, glm::vec3(0.6f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	room.Draw(shader);
-}
-
-void renderCrayons(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-92.1f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.77f, -0.74f, 0.0f));
-
-	model = glm::scale(model, glm::vec3(0.0100093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	crayons.Draw(shader);
-}
-
-void renderBike(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.25f, -0.565f, -1.18f));
-
-	model = glm::scale(model, glm::vec3(0.370001));
-
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	bike.Draw(shader);
-}
-
-void renderRug(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.04f, -0.555f, 0.0f));
-
-	model = glm::scale(model, glm::vec3(0.0100007f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	rug.Draw(shader);
-}
-
-void renderMug(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(63.5f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.68f, 0.03f, 1.1f));
-
-	model = glm::scale(model, glm::vec3(0.0400007));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	mug.Draw(shader);
-}
-
-void renderFox(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(96.5f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-1.01f, -0.2f, 0.2f));
-
-	model = glm::scale(model, glm::vec3(0.0100007f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
 
+// the filtered views of the shadow map: the comparison sampler and the moments targets
+void createShadowFilters() {
+	glGenSamplers(1, &shadowCompareSampler);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	float borderColor[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	glSamplerParameterfv(shadowCompareSampler, GL_TEXTURE_BORDER_COLOR, borderColor);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+	glSamplerParameteri(shadowCompareSampler, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+	glBindSampler(gps::TEXTURE_UNIT_SHADOW_COMPARE, shadowCompareSampler);
+
+	// 32 bit floats, the positive warp reaches e^80
+	glGenTextures(1, &momentsTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, momentsTexture);
+	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA32F, SHADOW_WIDTH, SHADOW_HEIGHT, shadowCascades, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	// allocates the mip chain
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+
+	glGenFramebuffers(shadowCascades, momentsFBO);
+	for (int i = 0; i < shadowCascades; i++) {
+		glBindFramebuffer(GL_FRAMEBUFFER, momentsFBO[i]);
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, momentsTexture, 0, i);
+	}
 
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	glGenTextures(1, &blurTexture);
+	glBindTexture(GL_TEXTURE_2D, blurTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, SHADOW_WIDTH, SHADOW_HEIGHT, 0, GL_RGBA, GL_FLOAT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	glGenFramebuffers(1, &blurFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, blurTexture, 0);
 
-	// draw model
-	fox.Draw(shader);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void renderSled(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(-89.0f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.69f, -0.56f, 1.0f));
-
-	model = glm::scale(model, glm::vec3(0.55f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	sled.Draw(shader);
+GLuint createGBufferTexture() {
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glBindTexture(GL_TEXTURE_2D, texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	return texture;
 }
 
-void renderDollHouse(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-92.5f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.51f, -0.26f, -0.59f));
-
-	model = glm::scale(model, glm::vec3(0.00600933f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	dollHouse.Draw(shader);
+// (re)allocates the G-buffer at the window size - 12 bytes per pixel
+void resizeGBuffer() {
+	int width = myWindow.getWindowDimensions().width;
+	int height = myWindow.getWindowDimensions().height;
+	if (width == gBufferWidth && height == gBufferHeight)
+		return;
+	gBufferWidth = width;
+	gBufferHeight = height;
+
+	// albedo and the specular colour averaged to one channel
+	glBindTexture(GL_TEXTURE_2D, gAlbedoSpecularTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	// octahedral normal, 16 bits per component
+	glBindTexture(GL_TEXTURE_2D, gNormalTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RG16, width, height, 0, GL_RG, GL_UNSIGNED_SHORT, NULL);
+	// the lighting pass rebuilds the position from the depth
+	glBindTexture(GL_TEXTURE_2D, gDepthTexture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_FLOAT, NULL);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	// bound behind the state cache's back, on whatever unit was active
+	gps::glState.invalidate();
 }
 
-void renderRacket(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-14.5f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(90.5f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.32f, 0.839999f, 0.53f));
-
-	model = glm::scale(model, glm::vec3(0.00700933));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	racket.Draw(shader);
+void createGBuffer() {
+	gAlbedoSpecularTexture = createGBufferTexture();
+	gNormalTexture = createGBufferTexture();
+	gDepthTexture = createGBufferTexture();
+	resizeGBuffer();
+
+	glGenFramebuffers(1, &gBufferFBO);
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, gAlbedoSpecularTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT1, GL_TEXTURE_2D, gNormalTexture, 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, gDepthTexture, 0);
+	GLenum drawBuffers[] = { GL_COLOR_ATTACHMENT0, GL_COLOR_ATTACHMENT1 };
+	glDrawBuffers(2, drawBuffers);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 }
 
-void renderTennisBall(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.42f, -0.54f, 0.82f));
-
-	model = glm::scale(model, glm::vec3(0.0100093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	tennisBall.Draw(shader);
+void initFBO() {
+	createShadowTarget(shadowMapFBO, depthMapTexture);
+	createShadowTarget(staticShadowFBO, staticShadowTexture);
+	createAtlasTarget(shadowAtlasFBO, shadowAtlasTexture);
+	createAtlasTarget(staticAtlasFBO, staticAtlasTexture);
+	createShadowFilters();
+	createGBuffer();
+
+	shadowMapTimer.create();
+	shadowFilterTimer.create();
+	mainPassTimer.create();
+	geometryPassTimer.create();
+	lightingPassTimer.create();
+
+	lightClusters.create();
 }
 
-void renderSoccerBall(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.989999f, -0.21f, 0.2));
-
-	model = glm::scale(model, glm::vec3(0.0710093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	soccerBall.Draw(shader);
+// fits each cascade's light frustum to its slice of the camera frustum, clipped to the scene
+void computeShadowCascades() {
+	glm::vec3 sceneMin(0.0f), sceneMax(0.0f);
+	frameBounds.enclose(sceneMin, sceneMax);
+
+	glm::mat4 lightView = gps::directionalLightView(glm::vec3(lightRotation * glm::vec4(lightDir, 0.0f)));
+	float splits[gps::MAX_SHADOW_CASCADES];
+	gps::cascadeSplits(CAMERA_NEAR, CAMERA_FAR, shadowCascades, splits);
+
+	float sliceNear = CAMERA_NEAR;
+	for (int i = 0; i < shadowCascades; i++) {
+		frameUniforms.lightSpaceTrMatrix[i] = gps::fitLightFrustum(lightView, view, projection, sliceNear, splits[i],
+			sceneMin, sceneMax, SHADOW_WIDTH);
+		frameUniforms.cascadeSplits[i] = splits[i];
+		sliceNear = splits[i];
+	}
+	frameUniforms.cascadeCount = shadowCascades;
+	frameUniforms.shadowFilter = shadowFilter;
 }
 
-void renderDoll(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(13.0f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-183.5f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.34f, 0.54f, -0.17f));
-
-	model = glm::scale(model, glm::vec3(0.00100932));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	barbieDoll.Draw(shader);
+// desk lamp cone in atlas tile 0, floor lamp cube faces in tiles 1-6
+void computeLampShadows() {
+	// a little wider than the 15 degree outer cut-off of collectLights
+	frameUniforms.atlasLightSpace[0] = gps::spotLightSpace(spotLightPos, spotLightDir, glm::radians(40.0f),
+		LAMP_NEAR, LAMP_FAR);
+	for (int face = 0; face < 6; face++)
+		frameUniforms.atlasLightSpace[1 + face] = gps::cubeFaceLightSpace(pointLightPos, face, LAMP_NEAR, LAMP_FAR);
 }
 
-void renderPony(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-19.5f), glm::vec3(0, 1, 0));
-	//model = glm::translate(glm::mat4(model), glm::vec3(-0.44f, -0.55f, -0.75f));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.44f, -0.55f, -0.939999f));
-
-	model = glm::scale(model, glm::vec3(0.0310093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	pony.Draw(shader);
+// the lights of the shaders' light loop: the sun by day, the desk and floor lamps at night
+void collectLights() {
+	const float ambientStrength = 0.2f;
+	// lamp falloff: constant, linear, quadratic
+	const glm::vec3 lampAttenuation(1.0f, 0.09f, 0.032f);
+
+	int count = 0;
+	if (night.x != 1.0f) {
+		gps::GpuLight& sun = frameUniforms.lights[count++];
+		sun.position = glm::vec4(glm::normalize(glm::mat3(view * lightRotation) * lightDir), 0.0f);
+		sun.color = glm::vec4(lightColor, ambientStrength);
+		sun.spot = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+		sun.attenuation = glm::vec4(1.0f, 0.0f, 0.0f, -1.0f);
+		sun.shadow = glm::ivec4(gps::LIGHT_SHADOW_CASCADES, 0, 0, 0);
+	}
+	else {
+		gps::GpuLight& deskLamp = frameUniforms.lights[count++];
+		deskLamp.position = view * spotLightPosV;
+		deskLamp.color = glm::vec4(lightColor, ambientStrength);
+		deskLamp.spot = glm::vec4(glm::normalize(glm::mat3(view) * spotLightDir), std::cos(glm::radians(15.0f)));
+		deskLamp.attenuation = glm::vec4(lampAttenuation, std::cos(glm::radians(12.5f)));
+		deskLamp.shadow = glm::ivec4(gps::LIGHT_SHADOW_ATLAS, 0, 0, 0);
+
+		gps::GpuLight& floorLamp = frameUniforms.lights[count++];
+		floorLamp.position = view * pointLightPosV;
+		floorLamp.color = glm::vec4(lightColor, ambientStrength);
+		floorLamp.spot = glm::vec4(0.0f, 0.0f, 0.0f, -1.0f);
+		floorLamp.attenuation = glm::vec4(lampAttenuation, -1.0f);
+		floorLamp.shadow = glm::ivec4(gps::LIGHT_SHADOW_ATLAS_CUBE, 1, 0, 0);
+	}
+	frameUniforms.lightCount = count;
 }
 
-void renderToyPlane(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(171.5f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.979999f, -0.06f, -0.06f));
-
-	model = glm::scale(model, glm::vec3(0.0110093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	toyPlane.Draw(shader);
+// uniform in [0, 1), the same sequence on every run so benchmark runs compare
+float nextRandom(uint32_t& state) {
+	state ^= state << 13;
+	state ^= state >> 17;
+	state ^= state << 5;
+	return (float)(state >> 8) / 16777216.0f;
 }
 
-void renderMovingPlane(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-
-	if (movePlane == true)
-		model = glm::rotate(model, glm::radians(anglePlane), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-31.0f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(xPlane, yPlane, zPlane));
-
-	model = glm::scale(model, glm::vec3(0.22601f));
-	
-	if (movePlane == true) {
-		if (xPlane <= -0.5 && yPlane <= 0.11)
-		{
-			xPlane += 0.01f;
-			yPlane += 0.01f;
-		}
-		else if (xPlane <= -0.130001f && anglePlane >= -36.5) {
-			xPlane += 0.01f;
-			yPlane += 0.005f;
-			anglePlane -= 0.05f;
-		}
-		else if (anglePlane >= -127.1f) {
-
-			anglePlane -= 0.7f;
-			yPlane += 0.0003f;
-
-			if (xPlane <= 0.219999f) {
-				xPlane += 0.001f;
-			}
-		}
-		else if (yPlane >= -0.567f) {
-			anglePlane -= 0.6f;
-			yPlane -= 0.0007f;
-		}
-		else {
-			movePlane = false;
-			stopMoving = true;
-		}
+// spreads MAX_CLUSTER_LIGHTS lights through the scene box with sizes relative to it
+void placeClusterLights() {
+	glm::vec3 sceneMin, sceneMax;
+	if (!frameBounds.enclose(sceneMin, sceneMax))
+		return;
+	float diagonal = glm::length(sceneMax - sceneMin);
+	clusterLightBob = diagonal * 0.01f;
+
+	uint32_t state = 0x9e3779b9u;
+	clusterLights.resize(MAX_CLUSTER_LIGHTS);
+	clusterLightAnchors.resize(MAX_CLUSTER_LIGHTS);
+	for (size_t i = 0; i < MAX_CLUSTER_LIGHTS; i++) {
+		glm::vec3 t(nextRandom(state), nextRandom(state), nextRandom(state));
+		clusterLightAnchors[i] = sceneMin + t * (sceneMax - sceneMin);
+		clusterLights[i].radius = diagonal * (0.03f + 0.04f * nextRandom(state));
+		// saturated hues
+		float hue = nextRandom(state) * 6.2831853f;
+		clusterLights[i].color = glm::vec3(0.5f + 0.5f * std::cos(hue), 0.5f + 0.5f * std::cos(hue - 2.0943951f),
+			0.5f + 0.5f * std::cos(hue + 2.0943951f));
 	}
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	movingPlane.Draw(shader);
 }
 
-void renderDogToy(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send teapot model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(63.0f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-92.5f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.23, 1.17, -0.5f));
-
-	model = glm::scale(model, glm::vec3(0.00600933f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw teapot
-	dogToy.Draw(shader);
+// moves the clustered lights with the scene, bins them for this frame's camera
+void buildLightClusters() {
+	if (clusterLightCount > 0 && clusterLightAnchors.empty())
+		placeClusterLights();
+	size_t count = std::min(clusterLightCount, clusterLights.size());
+
+	double start = glfwGetTime();
+	glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
+	for (size_t i = 0; i < count; i++) {
+		float bob = clusterLightBob * std::sin((float)start * (1.0f + 0.3f * (float)(i % 5)) + (float)i);
+		clusterLights[i].position = glm::vec3(rotation * glm::vec4(clusterLightAnchors[i] + glm::vec3(0.0f, bob, 0.0f), 1.0f));
+	}
+	lightClusters.build(clusterLights.data(), count, view, projection, CAMERA_NEAR, CAMERA_FAR);
+	clusterBinTime += glfwGetTime() - start;
+	clusterBinFrames++;
+
+	frameUniforms.clusterScale = glm::vec4(
+		(float)gps::LightClusters::CLUSTER_X / (float)myWindow.getWindowDimensions().width,
+		(float)gps::LightClusters::CLUSTER_Y / (float)myWindow.getWindowDimensions().height,
+		lightClusters.sliceScale(), lightClusters.sliceBias());
+	frameUniforms.clusterGrid = glm::ivec4(gps::LightClusters::CLUSTER_X, gps::LightClusters::CLUSTER_Y,
+		gps::LightClusters::CLUSTER_Z, clusteredLighting ? 1 : 0);
+	frameUniforms.clusterLightCount = (GLint)count;
 }
 
-void renderPonyHouse(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	//model = glm::translate(glm::mat4(model), glm::vec3(-0.03f, -0.56f, -1.23f));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.03f, -0.56f, -1.34f));
-
-	model = glm::scale(model, glm::vec3(0.00300932f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	ponyHouse.Draw(shader);
+// translation of stress copy n, copy 0 is the original room
+glm::mat4 stressOffset(unsigned int copy) {
+	if (copy == 0)
+		return glm::mat4(1.0f);
+	// rows of 8 behind the original
+	return glm::translate(glm::mat4(1.0f), glm::vec3((float)((int)(copy % 8) - 4) * 3.0f, 0.0f, (float)(-(int)(copy / 8) - 1) * 3.0f));
 }
 
-void renderPaperDoll(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-235.0f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-183.0f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.359999f, 0.539999f, -0.36f));
-
-	model = glm::scale(model, glm::vec3(0.00600933f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	paperDoll.Draw(shader);
-}
-
-void renderCatToy(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(71.0f), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-91.5f), glm::vec3(1, 0, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.17f, 0.969999f, -0.44f));
-
-	model = glm::scale(model, glm::vec3(0.0120093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	catToy.Draw(shader);
+// adds a model placed at local (relative to the room) and its stress copies; every copy is its
+// own group, so only the instances inside one copy of the room share a draw. Animated objects
+// pass the list receiving their entities and are kept out of the cached static shadows.
+void addObject(gps::Model3D& object, const glm::mat4& local, std::vector<gps::EntityStore::Entity>* entities = nullptr) {
+	for (unsigned int copy = 0; copy <= stressCopies; copy++) {
+		gps::EntityStore::Entity entity = scene.create(&object, stressOffset(copy) * local, copy, entities != nullptr);
+		if (entities)
+			entities->push_back(entity);
+	}
 }
 
-void renderFigurine(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.4f, -0.52f, -0.26f));
-
-	model = glm::scale(model, glm::vec3(1.65903f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	legoFigurine.Draw(shader);
+glm::mat4 movingPlaneLocal() {
+	glm::mat4 local = glm::mat4(1.0f);
+	if (movePlane == true)
+		local = glm::rotate(local, glm::radians(anglePlane), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(-31.0f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(xPlane, yPlane, zPlane));
+	return glm::scale(local, glm::vec3(0.22601f));
 }
 
-void renderNumberedDice(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(52.0f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(1.12f, -0.55f, -0.05f));
-
-	model = glm::scale(model, glm::vec3(0.0120093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	numberedDice.Draw(shader);
+glm::mat4 balloonLocal() {
+	glm::mat4 local = glm::rotate(glm::mat4(1.0f), glm::radians(-38.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(-0.47f, yBalloon, -1.21f));
+	return glm::scale(local, glm::vec3(0.0100093f));
 }
 
-
-void renderTruckToy(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(143.5f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(0.85f, 0.1105f, -0.54f));
-
-	model = glm::scale(model, glm::vec3(0.0700093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	truckToy.Draw(shader);
+void placeMovingPlane() {
+	glm::mat4 local = movingPlaneLocal();
+	for (size_t i = 0; i < movingPlaneEntities.size(); i++)
+		scene.setLocal(movingPlaneEntities[i], stressOffset((unsigned int)i) * local);
 }
 
-void renderFirstShelf(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-1.11f, 0.329999f, 0.79f));
+// places every object once, the room rotation (angle) is the scene root
+void initScene() {
+	glm::mat4 local;
 
-	model = glm::scale(model, glm::vec3(0.454007f));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-0.18f, -0.38f, -0.1f));
+	addObject(room, glm::scale(local, glm::vec3(0.6f)));
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	addObject(movingPlane, movingPlaneLocal(), &movingPlaneEntities);
 
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-0.04f, -0.555f, 0.0f));
+	addObject(rug, glm::scale(local, glm::vec3(0.0100007f)));
 
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(0.25f, -0.565f, -1.18f));
+	addObject(bike, glm::scale(local, glm::vec3(0.370001)));
 
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	// rotations about the vertical axis commute with the root, the order does not matter
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(63.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(-0.68f, 0.03f, 1.1f));
+	addObject(mug, glm::scale(local, glm::vec3(0.0400007)));
 
-	// draw model
-	shelf.Draw(shader);
-}
+	addObject(balloon, balloonLocal(), &balloonEntities);
 
-void renderSecondShelf(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-14.5f), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(90.5f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(-0.32f, 0.839999f, 0.53f));
+	addObject(racket, glm::scale(local, glm::vec3(0.00700933)));
 
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-1.12f, 0.329999f, -1.15f));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(171.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(0.979999f, -0.06f, -0.06f));
+	addObject(toyPlane, glm::scale(local, glm::vec3(0.0110093f)));
 
-	model = glm::scale(model, glm::vec3(0.454007f));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(96.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(-1.01f, -0.2f, 0.2f));
+	addObject(fox, glm::scale(local, glm::vec3(0.0100007f)));
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-19.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(-0.44f, -0.55f, -0.939999f));
+	addObject(pony, glm::scale(local, glm::vec3(0.0310093f)));
 
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(63.0f), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(-92.5f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(0.23, 1.17, -0.5f));
+	addObject(dogToy, glm::scale(local, glm::vec3(0.00600933f)));
 
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-89.0f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(0.69f, -0.56f, 1.0f));
+	addObject(sled, glm::scale(local, glm::vec3(0.55f)));
 
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-0.42f, -0.54f, 0.82f));
+	addObject(tennisBall, glm::scale(local, glm::vec3(0.0100093f)));
 
-	// draw model
-	shelf.Draw(shader);
-}
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(13.0f), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(-183.5f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(-0.34f, 0.54f, -0.17f));
+	addObject(barbieDoll, glm::scale(local, glm::vec3(0.00100932)));
 
-void renderPicture(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-92.5f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(-0.51f, -0.26f, -0.59f));
+	addObject(dollHouse, glm::scale(local, glm::vec3(0.00600933f)));
 
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-1.06f, 0.329999f, 0.82f));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-0.989999f, -0.21f, 0.2));
+	addObject(soccerBall, glm::scale(local, glm::vec3(0.0710093f)));
 
-	model = glm::scale(model, glm::vec3(0.128009f));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-0.03f, -0.56f, -1.34f));
+	addObject(ponyHouse, glm::scale(local, glm::vec3(0.00300932f)));
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-92.1f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(0.77f, -0.74f, 0.0f));
+	addObject(crayons, glm::scale(local, glm::vec3(0.0100093f)));
 
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-235.0f), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(-183.0f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(-0.359999f, 0.539999f, -0.36f));
+	addObject(paperDoll, glm::scale(local, glm::vec3(0.00600933f)));
 
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(71.0f), glm::vec3(0, 1, 0));
+	local = glm::rotate(local, glm::radians(-91.5f), glm::vec3(1, 0, 0));
+	local = glm::translate(local, glm::vec3(-0.17f, 0.969999f, -0.44f));
+	addObject(catToy, glm::scale(local, glm::vec3(0.0120093f)));
 
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(0.4f, -0.52f, -0.26f));
+	addObject(legoFigurine, glm::scale(local, glm::vec3(1.65903f)));
 
-	// draw model
-	picture.Draw(shader);
-}
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(52.0f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(1.12f, -0.55f, -0.05f));
+	addObject(numberedDice, glm::scale(local, glm::vec3(0.0120093f)));
 
-void renderFrame(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(143.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(0.85f, 0.1105f, -0.54f));
+	addObject(truckToy, glm::scale(local, glm::vec3(0.0700093f)));
 
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(179.5f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.999999f, 0.339999f, 0.45f));
+	// both shelves share the shelf meshes, one instanced draw per mesh
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-1.11f, 0.329999f, 0.79f));
+	addObject(shelf, glm::scale(local, glm::vec3(0.454007f)));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-1.12f, 0.329999f, -1.15f));
+	addObject(shelf, glm::scale(local, glm::vec3(0.454007f)));
 
-	model = glm::scale(model, glm::vec3(0.137009f));
+	local = glm::translate(glm::mat4(1.0f), glm::vec3(-1.06f, 0.329999f, 0.82f));
+	addObject(picture, glm::scale(local, glm::vec3(0.128009f)));
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(179.5f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(-0.999999f, 0.339999f, 0.45f));
+	addObject(frame, glm::scale(local, glm::vec3(0.137009f)));
 
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	frame.Draw(shader);
+	local = glm::rotate(glm::mat4(1.0f), glm::radians(-176.0f), glm::vec3(0, 1, 0));
+	local = glm::translate(local, glm::vec3(0.96f, 0.339999f, 1.18f));
+	addObject(books, glm::scale(local, glm::vec3(0.307009f)));
 }
 
-void renderBooks(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-176.0f), glm::vec3(0, 1, 0));
-
-	model = glm::translate(glm::mat4(model), glm::vec3(0.96f, 0.339999f, 1.18f));
+// flies the plane once started with Z, moves it only while flying
+void animateMovingPlane() {
+	if (movePlane == false)
+		return;
 
-	model = glm::scale(model, glm::vec3(0.307009f));
+	placeMovingPlane();
 
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
+	if (xPlane <= -0.5 && yPlane <= 0.11)
+	{
+		xPlane += 0.01f;
+		yPlane += 0.01f;
+	}
+	else if (xPlane <= -0.130001f && anglePlane >= -36.5) {
+		xPlane += 0.01f;
+		yPlane += 0.005f;
+		anglePlane -= 0.05f;
+	}
+	else if (anglePlane >= -127.1f) {
 
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
+		anglePlane -= 0.7f;
+		yPlane += 0.0003f;
 
-	// draw model
-	books.Draw(shader);
+		if (xPlane <= 0.219999f) {
+			xPlane += 0.001f;
+		}
+	}
+	else if (yPlane >= -0.567f) {
+		anglePlane -= 0.6f;
+		yPlane -= 0.0007f;
+	}
+	else {
+		movePlane = false;
+		stopMoving = true;
+		// landed, drawn without the flight rotation from the next frame on
+		placeMovingPlane();
+	}
 }
 
-void renderBalloon(gps::Shader shader, bool showMap) {
-	// select active shader program
-	shader.useShaderProgram();
-
-	//send model matrix data to shader
-	model = glm::translate(glm::mat4(1.0f), glm::vec3(0.0f, 0.0f, 0.0f));
-	model = glm::rotate(model, glm::radians(angle), glm::vec3(0, 1, 0));
-	model = glm::rotate(model, glm::radians(-38.5f), glm::vec3(0, 1, 0));
-	model = glm::translate(glm::mat4(model), glm::vec3(-0.47f, yBalloon, -1.21f));
+// bobs the balloon up and down
+void animateBalloon() {
+	glm::mat4 local = balloonLocal();
+	for (size_t i = 0; i < balloonEntities.size(); i++)
+		scene.setLocal(balloonEntities[i], stressOffset((unsigned int)i) * local);
 
 	if (yBalloon >= 0.0f)
 	{
@@ -1378,20 +1247,6 @@ void renderBalloon(gps::Shader shader, bool showMap) {
 		down = false;
 		up = true;
 	}
-
-	model = glm::scale(model, glm::vec3(0.0100093f));
-
-	glUniformMatrix4fv(glGetUniformLocation(shader.shaderProgram, "model"), 1, GL_FALSE, glm::value_ptr(model));
-
-
-	normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
-
-	//send normal matrix data to shader
-	if (!showMap)
-		glUniformMatrix3fv(normalMatrixLoc, 1, GL_FALSE, glm::value_ptr(normalMatrix));
-
-	// draw model
-	balloon.Draw(shader);
 }
 
 
@@ -1403,16 +1258,11 @@ void openingScene() {
 		if (moveForward >= 10) {
 			myCamera.move(gps::MOVE_FORWARD, cameraSpeed);
 			view = myCamera.getViewMatrix();
-			myBasicShader.useShaderProgram();
-			glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-			normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 		}
 	}
 	else {
 		if (angle <= 360 && startOpeningScene == true) {
 			angle += 1.0f;
-			model = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0));
-			normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 		}
 		else
 			if (moveForward <= 100 && startOpeningScene == true)
@@ -1420,125 +1270,493 @@ void openingScene() {
 				moveForward += 1.0f;
 				myCamera.move(gps::MOVE_BACKWARD, cameraSpeed);
 				view = myCamera.getViewMatrix();
-				myBasicShader.useShaderProgram();
-				glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-				normalMatrix = glm::mat3(glm::inverseTranspose(view * model));
 			}
 			else
 				startOpeningScene = false;
 	}
 }
 
-void drawObjects(gps::Shader shader, bool showMap) {
-
-	// render the models
-	renderRoom(shader, showMap);
-	renderMovingPlane(shader, showMap);
-	renderRug(shader, showMap);
-	renderBike(shader, showMap);
-	renderMug(shader, showMap);
-	renderBalloon(shader, showMap);
-	renderRacket(shader, showMap);
-	renderToyPlane(shader, showMap);
-	renderFox(shader, showMap);
-	renderPony(shader, showMap);
-	renderDogToy(shader, showMap);
-	renderSled(shader, showMap);
-	renderTennisBall(shader, showMap);
-	renderDoll(shader, showMap);
-	renderDollHouse(shader, showMap);
-	renderSoccerBall(shader, showMap);
-	renderPonyHouse(shader, showMap);
-	renderCrayons(shader, showMap);
-	renderPaperDoll(shader, showMap);
-	renderCatToy(shader, showMap);
-	renderFigurine(shader, showMap);
-	renderNumberedDice(shader, showMap);
-	renderTruckToy(shader, showMap);
-	renderFirstShelf(shader, showMap);
-	renderSecondShelf(shader, showMap);
-	renderPicture(shader, showMap);
-	renderFrame(shader, showMap);
-	renderBooks(shader, showMap);
+// updates the scene and writes the transforms that changed, shared by both passes
+void collectObjects() {
+	animateMovingPlane();
+	animateBalloon();
+
+	// the whole room turns with angle
+	scene.setRoot(glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0, 1, 0)));
+	sceneUpdates = scene.update();
+
+	const std::vector<gps::EntityStore::Run>& runs = scene.runs();
+	size_t slotCount = 0;
+	for (size_t i = 0; i < runs.size(); i++)
+		slotCount += runs[i].model->MeshCount() * runs[i].count;
+
+	transformBuffer.beginFrame(slotCount);
+	runTransforms.resize(runs.size());
+	if (runLodFirst.size() != runs.size()) {
+		runLodFirst.resize(runs.size());
+		size_t meshCount = 0;
+		for (size_t i = 0; i < runs.size(); i++) {
+			runLodFirst[i] = meshCount;
+			meshCount += runs[i].model->MeshCount();
+		}
+		runLods.assign(meshCount, 0);
+	}
+	for (size_t i = 0; i < runs.size(); i++) {
+		const gps::EntityStore::Run& run = runs[i];
+		runTransforms[i] = run.model->WriteTransforms(transformBuffer, scene.worldMatrices() + run.first,
+			scene.normalMatrices() + run.first, run.count, run.modified);
+	}
+	transformBuffer.finishWrites();
+
+	gps::glState.bindTexture(gps::TEXTURE_UNIT_TRANSFORMS, GL_TEXTURE_BUFFER, transformBuffer.texture());
+
+	// instanced runs are culled as a whole
+	frameBounds.clear();
+	for (size_t i = 0; i < runs.size(); i++) {
+		const gps::EntityStore::Run& run = runs[i];
+		frameBounds.add(run.model->boundsMin, run.model->boundsMax, scene.worldMatrices() + run.first, run.count);
+	}
+}
+
+// lightSpace is the matrix of the cascade or atlas tile drawn in the shadow pass, unused otherwise
+void drawObjects(gps::Shader& shader, bool showMap, PassCasters casters = CASTERS_ALL,
+	const glm::mat4& lightSpace = glm::mat4(1.0f)) {
+	// cull against the light frustum in the shadow pass, the camera frustum otherwise
+	glm::mat4 viewProjection = showMap ? lightSpace : projection * view;
+	const std::vector<gps::EntityStore::Run>& runs = scene.runs();
+	frameBounds.cull(viewProjection, frameVisible);
+
+	// sort depth: distance along the light direction in the shadow pass (clip z + w, 0..2 inside
+	// the light frustum), eye-space distance in the main pass
+	glm::mat4 depthMatrix = showMap ? viewProjection : view;
+	glm::vec4 depthPlane = glm::vec4(depthMatrix[0][2], depthMatrix[1][2], depthMatrix[2][2], depthMatrix[3][2]);
+	if (showMap)
+		depthPlane += glm::vec4(depthMatrix[0][3], depthMatrix[1][3], depthMatrix[2][3], depthMatrix[3][3]);
+	else
+		depthPlane = -depthPlane;
+	float maxDepth = showMap ? 2.0f : 20.0f;
+
+	size_t objects = 0;
+	size_t culled = 0;
+	renderQueue.clear();
+	for (size_t i = 0; i < runs.size(); i++) {
+		if ((casters == CASTERS_STATIC && runs[i].dynamic) || (casters == CASTERS_DYNAMIC && !runs[i].dynamic))
+			continue;
+		objects++;
+		if (!frameVisible[i]) {
+			culled++;
+			continue;
+		}
+
+		// the nearest instance decides the sort depth and the level of detail
+		const gps::EntityStore::Run& run = runs[i];
+		const glm::mat4* instances = scene.worldMatrices() + run.first;
+		const glm::mat4* nearest = instances;
+		for (uint32_t k = 1; k < run.count; k++) {
+			const glm::mat4& instance = instances[k];
+			if (glm::dot(depthPlane, instance[3]) < glm::dot(depthPlane, (*nearest)[3]))
+				nearest = &instance;
+		}
+
+		int* levels = runLods.data() + runLodFirst[i];
+		if (!showMap)
+			run.model->SelectLod(*nearest, view, projection, (float)myWindow.getWindowDimensions().height, levels);
+		run.model->Submit(renderQueue, *nearest, levels, runTransforms[i], run.count, shader.shaderProgram,
+			depthPlane, maxDepth, showMap);
+	}
+	renderQueue.sort();
+
+	size_t drawCalls = 0;
+	if (gps::Mesh::pooledGeometry) {
+		// one multi-draw per index type and texture set (per index type in the shadow pass)
+		drawCommands.clear();
+		drawTransforms.clear();
+		for (size_t i = 0; i < renderQueue.size(); i++) {
+			const gps::RenderQueue::Item& item = renderQueue[i];
+			drawCommands.push_back(item.mesh->indirectCommand(item.level, item.instances, (GLuint)drawTransforms.size()));
+			drawTransforms.insert(drawTransforms.end(), item.instances, item.transform);
+		}
+		gps::geometryPool.setDraws(drawCommands, drawTransforms);
+
+		shader.useShaderProgram();
+		size_t runStart = 0;
+		for (size_t i = 1; i <= renderQueue.size(); i++) {
+			const gps::Mesh* batch = renderQueue[runStart].mesh;
+			if (i < renderQueue.size() && renderQueue[i].mesh->getIndexType() == batch->getIndexType() &&
+				(showMap || renderQueue[i].mesh->textureSet == batch->textureSet))
+				continue;
+			if (!showMap)
+				batch->bindTextures();
+			drawCalls += gps::geometryPool.multiDraw(runStart, i - runStart, batch->getIndexType(), showMap);
+			runStart = i;
+		}
+	}
+	else {
+		// draw in key order, the shaders fetch the transforms by slot
+		shader.useShaderProgram();
+		for (size_t i = 0; i < renderQueue.size(); i++) {
+			const gps::RenderQueue::Item& item = renderQueue[i];
+			glVertexAttribI1ui(gps::GeometryPool::TRANSFORM_ATTRIBUTE, item.transform);
+			if (showMap)
+				item.mesh->DrawDepth(item.level, item.instances);
+			else
+				item.mesh->Draw(shader, item.level, item.instances);
+		}
+		drawCalls = renderQueue.size();
+	}
+
+	PassStats& stats = showMap ? shadowPassStats : mainPassStats;
+	stats.objects += objects;
+	stats.culled += culled;
+	stats.meshes += renderQueue.size();
+	stats.drawCalls += drawCalls;
+}
+
+void reportFrameStats() {
+	double now = glfwGetTime();
+	if (!showFrameStats || now - lastFrameReport < 1.0)
+		return;
+	lastFrameReport = now;
+
+	std::cout << "culled objects - shadow pass: " << shadowPassStats.culled << "/" << shadowPassStats.objects
+		<< ", main pass: " << mainPassStats.culled << "/" << mainPassStats.objects << std::endl;
+	std::cout << "draw calls - shadow pass: " << shadowPassStats.drawCalls << " (" << shadowPassStats.meshes << " meshes)"
+		<< ", main pass: " << mainPassStats.drawCalls << " (" << mainPassStats.meshes << " meshes)"
+		<< (gps::Mesh::pooledGeometry ? (gps::geometryPool.indirect() ? ", multi-draw indirect" : ", pooled") : ", separate buffers")
+		<< std::endl;
+	std::cout << "CPU frame time: " << (cpuFrameCount ? cpuFrameTime / cpuFrameCount * 1000.0 : 0.0) << " ms" << std::endl;
+	cpuFrameTime = 0.0;
+	cpuFrameCount = 0;
+	std::cout << "static shadow casters re-rendered: " << staticShadowRenders << "/" << shadowFrames
+		<< " cascades (" << shadowCascades << " per frame)" << std::endl;
+	shadowFrames = 0;
+	staticShadowRenders = 0;
+	std::cout << "lamp shadow tiles composited: " << lampTileComposites << "/" << lampTileFrames
+		<< ", static casters re-rendered: " << lampStaticRenders << std::endl;
+	lampTileFrames = 0;
+	lampTileComposites = 0;
+	lampStaticRenders = 0;
+	std::cout << "GPU time (" << SHADOW_FILTER_NAMES[shadowFilter] << " shadows) - shadow maps: "
+		<< shadowMapTimer.averageMs() << " ms, moments filter: " << shadowFilterTimer.averageMs()
+		<< " ms (" << momentsUpdates << " updates), main pass: " << mainPassTimer.averageMs() << " ms" << std::endl;
+	shadowMapTimer.reset();
+	shadowFilterTimer.reset();
+	mainPassTimer.reset();
+	momentsUpdates = 0;
+	if (deferredShading) {
+		std::cout << "deferred shading - geometry pass: " << geometryPassTimer.averageMs()
+			<< " ms, lighting pass: " << lightingPassTimer.averageMs() << " ms" << std::endl;
+	}
+	geometryPassTimer.reset();
+	lightingPassTimer.reset();
+	std::cout << "clustered lights: " << frameUniforms.clusterLightCount
+		<< (clusteredLighting ? "" : " (every light per fragment)")
+		<< ", light references: " << lightClusters.indexCount()
+		<< ", binning: " << (clusterBinFrames ? clusterBinTime / clusterBinFrames * 1000.0 : 0.0) << " ms" << std::endl;
+	clusterBinTime = 0.0;
+	clusterBinFrames = 0;
+	std::cout << "GL state calls - issued: " << gps::glState.lastFrameIssued()
+		<< ", skipped: " << gps::glState.lastFrameSkipped() << std::endl;
+	std::cout << "entities updated: " << sceneUpdates << "/" << scene.size()
+		<< ", transforms written: " << transformBuffer.lastFrameWritten()
+		<< ", fence stalls: " << transformBuffer.stalls() << std::endl;
+}
+
+// fills the FrameUniforms block for this frame, the only place the per-frame values are uploaded
+void updateFrameUniforms() {
+	view = myCamera.getViewMatrix();
+
+	frameUniforms.view = view;
+	frameUniforms.projection = projection;
+	computeShadowCascades();
+	computeLampShadows();
+	collectLights();
+	buildLightClusters();
+
+	frameUniformBuffer.update(frameUniforms);
+}
+
+// deferred path: the scene into the G-buffer, then the lights over it into the window
+void renderDeferred() {
+	resizeGBuffer();
+
+	geometryPassTimer.begin();
+	glBindFramebuffer(GL_FRAMEBUFFER, gBufferFBO);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+	drawObjects(gBufferShader, false);
+	geometryPassTimer.end();
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	lightingPassTimer.begin();
+	deferredLightingShader.useShaderProgram();
+	gps::glState.bindTexture(gps::TEXTURE_UNIT_G_ALBEDO_SPECULAR, GL_TEXTURE_2D, gAlbedoSpecularTexture);
+	gps::glState.bindTexture(gps::TEXTURE_UNIT_G_NORMAL, GL_TEXTURE_2D, gNormalTexture);
+	gps::glState.bindTexture(gps::TEXTURE_UNIT_G_DEPTH, GL_TEXTURE_2D, gDepthTexture);
+	// the pass copies the G-buffer depth into the window's, the skybox is tested against it
+	gps::glState.depthFunc(GL_ALWAYS);
+	screenQuad.Draw(deferredLightingShader, glm::mat4(1.0f));
+	gps::glState.depthFunc(GL_LESS);
+	lightingPassTimer.end();
+}
+
+// true when a moving caster inside the tile's frustum moved, or one that was inside at the last composite
+bool lampCasterMoved(int tile) {
+	const std::vector<gps::EntityStore::Run>& runs = scene.runs();
+	frameBounds.cull(frameUniforms.atlasLightSpace[tile], lampVisible);
+	lampCasters[tile].resize(runs.size(), 0);
+	for (size_t i = 0; i < runs.size(); i++) {
+		if (runs[i].dynamic && runs[i].modified && (lampVisible[i] || lampCasters[tile][i]))
+			return true;
+	}
+	return false;
+}
+
+// spot and point light shadows, drawn only at night when the lamps are on. A tile is composited
+// again from its cached static casters only when its frustum changed, a static caster moved or a
+// moving caster inside the lamp's reach moved, so a still scene draws nothing here.
+void renderLampShadows() {
+	if (night.x != 1.0f) {
+		// whatever moved meanwhile is not tracked
+		lampShadowValid = false;
+		return;
+	}
+
+	glEnable(GL_SCISSOR_TEST);
+	for (int tile = 0; tile < gps::SHADOW_ATLAS_TILES; tile++) {
+		const glm::mat4& lightSpace = frameUniforms.atlasLightSpace[tile];
+		GLint x = (tile % ATLAS_COLUMNS) * ATLAS_TILE_SIZE;
+		GLint y = (tile / ATLAS_COLUMNS) * ATLAS_TILE_SIZE;
+
+		lampTileFrames++;
+		bool staticDirty = !lampShadowValid || scene.staticModified() || lightSpace != staticAtlasLightSpace[tile];
+		if (!lampCasterMoved(tile) && !staticDirty)
+			continue;
+
+		// the scissor keeps the clear and the copy inside the tile
+		gps::glState.viewport(x, y, ATLAS_TILE_SIZE, ATLAS_TILE_SIZE);
+		glScissor(x, y, ATLAS_TILE_SIZE, ATLAS_TILE_SIZE);
+		depthMapShader.setInt(gps::UNIFORM_ATLAS_TILE, tile);
+
+		if (staticDirty) {
+			glBindFramebuffer(GL_FRAMEBUFFER, staticAtlasFBO);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			drawObjects(depthMapShader, true, CASTERS_STATIC, lightSpace);
+			staticAtlasLightSpace[tile] = lightSpace;
+			lampStaticRenders++;
+		}
+
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticAtlasFBO);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowAtlasFBO);
+		glBlitFramebuffer(x, y, x + ATLAS_TILE_SIZE, y + ATLAS_TILE_SIZE, x, y, x + ATLAS_TILE_SIZE, y + ATLAS_TILE_SIZE,
+			GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, shadowAtlasFBO);
+		drawObjects(depthMapShader, true, CASTERS_DYNAMIC, lightSpace);
+
+		for (size_t i = 0; i < lampVisible.size(); i++)
+			lampCasters[tile][i] = lampVisible[i];
+		lampTileComposites++;
+	}
+	glDisable(GL_SCISSOR_TEST);
+	depthMapShader.setInt(gps::UNIFORM_ATLAS_TILE, -1);
+	lampShadowValid = true;
+}
+
+// converts each cascade to exponential variance moments, blurs them with a separable gaussian
+// and builds their mip chain, so the main pass filters them with a single fetch
+void filterShadowMoments() {
+	gps::glState.viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+	gps::glState.depthTest(false);
+	evsmBlurShader.useShaderProgram();
+	//depthMap samples unit 0
+	gps::glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+
+	for (int cascade = 0; cascade < shadowCascades; cascade++) {
+		evsmBlurShader.setInt(gps::UNIFORM_CASCADE, cascade);
+
+		// horizontal, depth to moments; the blur target must not stay bound while drawn into
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_BLUR_SOURCE, GL_TEXTURE_2D, 0);
+		glBindFramebuffer(GL_FRAMEBUFFER, blurFBO);
+		evsmBlurShader.setInt(gps::UNIFORM_BLUR_VERTICAL, 0);
+		screenQuad.Draw(evsmBlurShader, glm::mat4(1.0f));
+
+		// vertical, into the cascade's layer
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_BLUR_SOURCE, GL_TEXTURE_2D, blurTexture);
+		glBindFramebuffer(GL_FRAMEBUFFER, momentsFBO[cascade]);
+		evsmBlurShader.setInt(gps::UNIFORM_BLUR_VERTICAL, 1);
+		screenQuad.Draw(evsmBlurShader, glm::mat4(1.0f));
+	}
+	gps::glState.depthTest(true);
+
+	gps::glState.bindTexture(gps::TEXTURE_UNIT_SHADOW_MOMENTS, GL_TEXTURE_2D_ARRAY, momentsTexture);
+	// the bind is skipped while the texture stays on its unit, select the unit anyway
+	gps::glState.activeTexture(gps::TEXTURE_UNIT_SHADOW_MOMENTS);
+	glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+	momentsUpdates++;
 }
 
 void renderWithShadowMapping() {
+	shadowMapTimer.begin();
 	depthMapShader.useShaderProgram();
 
-	glUniformMatrix4fv(glGetUniformLocation(depthMapShader.shaderProgram, "lightSpaceTrMatrix"), 1, GL_FALSE, glm::value_ptr(computeLightSpaceTrMatrix()));
+	gps::glState.viewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
+
+	// the cascades differ from last frame's when a static re-render ran or a moving caster moved
+	const std::vector<gps::EntityStore::Run>& runs = scene.runs();
+	bool shadowMapChanged = false;
+	for (size_t i = 0; i < runs.size(); i++)
+		shadowMapChanged = shadowMapChanged || (runs[i].dynamic && runs[i].modified);
+
+	for (int cascade = 0; cascade < shadowCascades; cascade++) {
+		const glm::mat4& lightSpace = frameUniforms.lightSpaceTrMatrix[cascade];
+		depthMapShader.setInt(gps::UNIFORM_CASCADE, cascade);
+
+		// static casters only when they or the cascade's frustum moved
+		shadowFrames++;
+		if (!staticShadowValid || scene.staticModified() || lightSpace != staticShadowLightSpace[cascade]) {
+			glBindFramebuffer(GL_FRAMEBUFFER, staticShadowFBO[cascade]);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			drawObjects(depthMapShader, true, CASTERS_STATIC, lightSpace);
+			staticShadowLightSpace[cascade] = lightSpace;
+			staticShadowRenders++;
+			shadowMapChanged = true;
+		}
+
+		// start from the cached depth, the moving casters go on top
+		glBindFramebuffer(GL_READ_FRAMEBUFFER, staticShadowFBO[cascade]);
+		glBindFramebuffer(GL_DRAW_FRAMEBUFFER, shadowMapFBO[cascade]);
+		glBlitFramebuffer(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT, 0, 0, SHADOW_WIDTH, SHADOW_HEIGHT, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO[cascade]);
+		drawObjects(depthMapShader, true, CASTERS_DYNAMIC, lightSpace);
+	}
+	staticShadowValid = true;
 
-	glViewport(0, 0, SHADOW_WIDTH, SHADOW_HEIGHT);
-	glBindFramebuffer(GL_FRAMEBUFFER, shadowMapFBO);
-	glClear(GL_DEPTH_BUFFER_BIT);
+	renderLampShadows();
+	shadowMapTimer.end();
 
-	drawObjects(depthMapShader, true);
+	// prefiltered once per shadow map update, the other filters read the depth directly
+	if (shadowFilter != gps::SHADOW_FILTER_EVSM) {
+		momentsValid = false;
+	}
+	else if (!momentsValid || shadowMapChanged) {
+		shadowFilterTimer.begin();
+		filterShadowMoments();
+		shadowFilterTimer.end();
+		momentsValid = true;
+	}
 
 	glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
 	// render depth map on screen - toggled with the C key
 
 	if (showDepthMap) {
-		glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+		gps::glState.viewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
 
 		glClear(GL_COLOR_BUFFER_BIT);
 
 		screenQuadShader.useShaderProgram();
 
-		//bind the depth map
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-		glUniform1i(glGetUniformLocation(screenQuadShader.shaderProgram, "depthMap"), 0);
+		//bind the depth map (depthMap samples unit 0)
+		gps::glState.bindTexture(0, GL_TEXTURE_2D_ARRAY, depthMapTexture);
 
-		glDisable(GL_DEPTH_TEST);
-		screenQuad.Draw(screenQuadShader);
-		glEnable(GL_DEPTH_TEST);
+		gps::glState.depthTest(false);
+		screenQuad.Draw(screenQuadShader, glm::mat4(1.0f));
+		gps::glState.depthTest(true);
 	}
 	else {
 
 		// final scene rendering pass (with shadows)
 
-		glViewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
+		gps::glState.viewport(0, 0, myWindow.getWindowDimensions().width, myWindow.getWindowDimensions().height);
 
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-		myBasicShader.useShaderProgram();
-
-		view = myCamera.getViewMatrix();
-		glUniformMatrix4fv(viewLoc, 1, GL_FALSE, glm::value_ptr(view));
-
-		lightRotation = glm::mat4(1.0f);
-		glUniform3fv(lightDirLoc, 1, glm::value_ptr(glm::inverseTranspose(glm::mat3(view * lightRotation)) * lightDir));
-
 		//bind the shadow map
-		glActiveTexture(GL_TEXTURE3);
-		glBindTexture(GL_TEXTURE_2D, depthMapTexture);
-		glUniform1i(glGetUniformLocation(myBasicShader.shaderProgram, "shadowMap"), 3);
-
-		glUniformMatrix4fv(glGetUniformLocation(myBasicShader.shaderProgram, "lightSpaceTrMatrix"),
-			1,
-			GL_FALSE,
-			glm::value_ptr(computeLightSpaceTrMatrix()));
-
-		drawObjects(myBasicShader, false);
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_SHADOW_MAP, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_SHADOW_ATLAS, GL_TEXTURE_2D, shadowAtlasTexture);
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_SHADOW_COMPARE, GL_TEXTURE_2D_ARRAY, depthMapTexture);
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_SHADOW_MOMENTS, GL_TEXTURE_2D_ARRAY, momentsTexture);
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_CLUSTER_LIGHTS, GL_TEXTURE_BUFFER, lightClusters.lightTexture());
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_CLUSTER_RANGES, GL_TEXTURE_BUFFER, lightClusters.rangeTexture());
+		gps::glState.bindTexture(gps::TEXTURE_UNIT_CLUSTER_INDICES, GL_TEXTURE_BUFFER, lightClusters.indexTexture());
+
+		if (deferredShading) {
+			renderDeferred();
+		}
+		else {
+			myBasicShader.useShaderProgram();
+			mainPassTimer.begin();
+			drawObjects(myBasicShader, false);
+			mainPassTimer.end();
+		}
 	}
 }
 
 void renderScene() {
+	double frameStart = glfwGetTime();
+	gps::glState.beginFrame();
+	shadowPassStats = PassStats();
+	mainPassStats = PassStats();
+
+	// get point light and spot light positions
+	getPointLightPos();
+	getSpotLightPos();
+
+	collectObjects();
+	updateFrameUniforms();
+
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 	// render the scene
 	renderWithShadowMapping();
 
 	// render the skybox
-	mySkyBox.Draw(skyboxShader, view, projection);
+	mySkyBox.Draw(skyboxShader);
 
-	// get point light and spot light positions
-	getPointLightPos();
-	getSpotLightPos();
+	transformBuffer.endFrame();
 
 	// start openin scene animation
 	openingScene();
 
+	cpuFrameTime += glfwGetTime() - frameStart;
+	cpuFrameCount++;
+
+	reportFrameStats();
+
+}
+
+void startLightBenchmarkStep() {
+	clusterLightCount = (size_t)2 << (benchmarkStep / 2);
+	clusteredLighting = benchmarkStep % 2 == 0;
+	benchmarkFrame = 0;
+}
+
+// one row per light count and lighting mode, closes the window after the last one
+void stepLightBenchmark() {
+	if (!benchmarkLights)
+		return;
+	benchmarkFrame++;
+	if (benchmarkFrame == BENCHMARK_WARMUP_FRAMES) {
+		mainPassTimer.reset();
+		geometryPassTimer.reset();
+		lightingPassTimer.reset();
+		clusterBinTime = 0.0;
+		clusterBinFrames = 0;
+	}
+	if (benchmarkFrame < BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES)
+		return;
+
+	std::cout << clusterLightCount << "\t" << (clusteredLighting ? "clustered" : "every light")
+		<< "\t" << (deferredShading ? geometryPassTimer.averageMs() + lightingPassTimer.averageMs() : mainPassTimer.averageMs()) << " ms"
+		<< "\t" << (clusterBinFrames ? clusterBinTime / clusterBinFrames * 1000.0 : 0.0) << " ms"
+		<< "\t" << lightClusters.indexCount() << std::endl;
+
+	benchmarkStep++;
+	if (((size_t)2 << (benchmarkStep / 2)) > MAX_CLUSTER_LIGHTS) {
+		benchmarkLights = false;
+		glfwSetWindowShouldClose(myWindow.getWindow(), GL_TRUE);
+		return;
+	}
+	startLightBenchmarkStep();
 }
 
 void cleanup() {
@@ -1548,6 +1766,42 @@ void cleanup() {
 
 int main(int argc, const char* argv[]) {
 
+	// --bench-obj [faces] : measure the .obj parser thread scaling and exit
+	if (argc > 1 && std::string(argv[1]) == "--bench-obj") {
+		gps::BenchmarkObjParsing(argc > 2 ? std::stoul(argv[2]) : 4000000);
+		return EXIT_SUCCESS;
+	}
+
+	// --stress [copies] : add copies of the scene, --separate-buffers : one vertex array per mesh,
+	// --cascades n : directional shadow cascades (1-4), --shadow-filter hard|pcf|evsm
+	// --lights n : clustered point lights (up to 1024), --no-clusters : every light in every fragment
+	// --bench-lights : main pass GPU time with 2 to 1024 lights, clustered and not, then exit
+	// --deferred : start on the deferred shading path (TAB switches at runtime)
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		if (arg == "--stress")
+			stressCopies = (i + 1 < argc && isdigit((unsigned char)argv[i + 1][0])) ? std::stoul(argv[++i]) : 16;
+		else if (arg == "--separate-buffers")
+			gps::Mesh::pooledGeometry = false;
+		else if (arg == "--cascades" && i + 1 < argc)
+			shadowCascades = std::min(std::max(std::atoi(argv[++i]), 1), gps::MAX_SHADOW_CASCADES);
+		else if (arg == "--shadow-filter" && i + 1 < argc) {
+			std::string name = argv[++i];
+			for (int filter = 0; filter < gps::SHADOW_FILTER_COUNT; filter++) {
+				if (name == SHADOW_FILTER_NAMES[filter])
+					shadowFilter = (gps::ShadowFilter)filter;
+			}
+		}
+		else if (arg == "--lights" && i + 1 < argc)
+			clusterLightCount = std::min((size_t)std::stoul(argv[++i]), MAX_CLUSTER_LIGHTS);
+		else if (arg == "--no-clusters")
+			clusteredLighting = false;
+		else if (arg == "--bench-lights")
+			benchmarkLights = true;
+		else if (arg == "--deferred")
+			deferredShading = true;
+	}
+
 	try {
 		initOpenGLWindow();
 	}
@@ -1558,6 +1812,7 @@ int main(int argc, const char* argv[]) {
 
 	initOpenGLState();
 	initModels();
+	initScene();
 	initShaders();
 	initUniforms();
 	initFBO();
@@ -1574,20 +1829,20 @@ int main(int argc, const char* argv[]) {
 	faces.push_back("skybox/front.tga");
 
 	mySkyBox.Load(faces);
-	view = myCamera.getViewMatrix();
-	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "view"), 1, GL_FALSE,
-		glm::value_ptr(view));
 
-	projection = glm::perspective(glm::radians(45.0f),
-		(float)myWindow.getWindowDimensions().width / (float)myWindow.getWindowDimensions().height,
-		0.1f, 20.0f);
-	glUniformMatrix4fv(glGetUniformLocation(skyboxShader.shaderProgram, "projection"), 1, GL_FALSE,
-		glm::value_ptr(projection));
+	// the loading code bound textures and buffers directly
+	gps::glState.invalidate();
 
 	// application loop
+	if (benchmarkLights) {
+		std::cout << "lights\tlighting\tmain pass GPU\tbinning CPU\tlight references" << std::endl;
+		startLightBenchmarkStep();
+	}
+
 	while (!glfwWindowShouldClose(myWindow.getWindow())) {
 		processMovement();
 		renderScene();
+		stepLightBenchmark();
 
 		glfwPollEvents();
 		glfwSwapBuffers(myWindow.getWindow());
@@ -228,6 +228,20 @@ namespace tinyobj {
                  std::istream *inStream, MaterialReader *readMatFn = NULL,
                  bool triangulate = true);
     
+    /// Loads .obj from a memory buffer, typically a memory mapped file.
+    /// Tokenizes the buffer in place (no getline/sscanf copies) and pre-sizes
+    /// the attribute arrays with a counting pass.
+    /// 'num_threads' > 1 splits large buffers into line aligned chunks that
+    /// are parsed in parallel and stitched back in file order.
+    /// Produces the same `attrib`, `shapes` and `materials` as LoadObj().
+    /// The buffer does not need to be null terminated.
+    bool LoadObjFromBuffer(attrib_t *attrib, std::vector<shape_t> *shapes,
+                           std::vector<material_t> *materials, std::string *err,
+                           const char *buffer, size_t length,
+                           MaterialReader *readMatFn = NULL,
+                           bool triangulate = true,
+                           unsigned int num_threads = 1);
+    
     /// Loads materials into std::map
     void LoadMtl(std::map<std::string, int> *material_map,
                  std::vector<material_t> *materials, std::istream *inStream);
@@ -241,6 +255,8 @@ namespace tinyobj {
 #include <cstddef>
 #include <cstdlib>
 #include <cstring>
+#include <charconv>
+#include <thread>
 #include <utility>
 
 #include <fstream>
@@ -638,6 +654,53 @@ namespace tinyobj {
         material->unknown_parameter.clear();
     }
     
+    // Parses a 't' (SubD tag) line. `token` points at the 't'.
+    static tag_t parseTagLine(const char *token) {
+        tag_t tag;
+        
+        char namebuf[4096];
+        token += 2;
+#ifdef _MSC_VER
+        sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
+#else
+        sscanf(token, "%s", namebuf);
+#endif
+        tag.name = std::string(namebuf);
+        
+        token += tag.name.size() + 1;
+        
+        tag_sizes ts = parseTagTriple(&token);
+        
+        tag.intValues.resize(static_cast<size_t>(ts.num_ints));
+        
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
+            tag.intValues[i] = atoi(token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+        
+        tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_floats); ++i) {
+            tag.floatValues[i] = parseFloat(&token);
+            token += strcspn(token, "/ \t\r") + 1;
+        }
+        
+        tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
+        for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
+            char stringValueBuffer[4096];
+            
+#ifdef _MSC_VER
+            sscanf_s(token, "%s", stringValueBuffer,
+                     (unsigned)_countof(stringValueBuffer));
+#else
+            sscanf(token, "%s", stringValueBuffer);
+#endif
+            tag.stringValues[i] = stringValueBuffer;
+            token += tag.stringValues[i].size() + 1;
+        }
+        
+        return tag;
+    }
+    
     static bool exportFaceGroupToShape(
                                        shape_t *shape, const std::vector<std::vector<vertex_index> > &faceGroup,
                                        const std::vector<tag_t> &tags, const int material_id,
@@ -1307,49 +1370,7 @@ namespace tinyobj {
             }
             
             if (token[0] == 't' && IS_SPACE(token[1])) {
-                tag_t tag;
-                
-                char namebuf[4096];
-                token += 2;
-#ifdef _MSC_VER
-                sscanf_s(token, "%s", namebuf, (unsigned)_countof(namebuf));
-#else
-                sscanf(token, "%s", namebuf);
-#endif
-                tag.name = std::string(namebuf);
-                
-                token += tag.name.size() + 1;
-                
-                tag_sizes ts = parseTagTriple(&token);
-                
-                tag.intValues.resize(static_cast<size_t>(ts.num_ints));
-                
-                for (size_t i = 0; i < static_cast<size_t>(ts.num_ints); ++i) {
-                    tag.intValues[i] = atoi(token);
-                    token += strcspn(token, "/ \t\r") + 1;
-                }
-                
-                tag.floatValues.resize(static_cast<size_t>(ts.num_floats));
-                for (size_t i = 0; i < static_cast<size_t>(ts.num_floats); ++i) {
-                    tag.floatValues[i] = parseFloat(&token);
-                    token += strcspn(token, "/ \t\r") + 1;
-                }
-                
-                tag.stringValues.resize(static_cast<size_t>(ts.num_strings));
-                for (size_t i = 0; i < static_cast<size_t>(ts.num_strings); ++i) {
-                    char stringValueBuffer[4096];
-                    
-#ifdef _MSC_VER
-                    sscanf_s(token, "%s", stringValueBuffer,
-                             (unsigned)_countof(stringValueBuffer));
-#else
-                    sscanf(token, "%s", stringValueBuffer);
-#endif
-                    tag.stringValues[i] = stringValueBuffer;
-                    token += tag.stringValues[i].size() + 1;
-                }
-                
-                tags.push_back(tag);
+                tags.push_back(parseTagLine(token));
             }
             
             // Ignore unknown command.
@@ -1655,6 +1676,558 @@ namespace tinyobj {
         
         return true;
     }
+    
+    // ---- In-place parsing of a memory buffer (LoadObjFromBuffer) ----
+    //
+    // The helpers below mirror parseFloat/parseTriple/parseString but work on
+    // [token, line_end) ranges of the original buffer instead of a copied,
+    // null terminated line.
+    
+    static inline const char *skipSpaceFast(const char *p, const char *end) {
+        while (p < end && IS_SPACE(*p)) p++;
+        return p;
+    }
+    
+    static inline const char *skipTokenFast(const char *p, const char *end) {
+        while (p < end && !IS_SPACE(*p) && *p != '\r') p++;
+        return p;
+    }
+    
+    static inline float parseFloatFast(const char **token, const char *end,
+                                       float default_value = 0.0f) {
+        const char *s = skipSpaceFast(*token, end);
+        const char *e = skipTokenFast(s, end);
+        float value = default_value;
+        // from_chars does not accept a leading '+'
+        const char *first = (s < e && *s == '+') ? s + 1 : s;
+        if (std::from_chars(first, e, value).ec != std::errc()) {
+            value = default_value;
+        }
+        (*token) = e;
+        return value;
+    }
+    
+    // atoi() equivalent on a bounded range: leading '+'/'-', stops at the first
+    // non digit, 0 when there is no number.
+    static inline int parseIntFast(const char *p, const char *end) {
+        if (p < end && *p == '+') p++;
+        int value = 0;
+        if (std::from_chars(p, end, value).ec != std::errc()) {
+            value = 0;
+        }
+        return value;
+    }
+    
+    static inline const char *skipIndexFast(const char *p, const char *end) {
+        while (p < end && *p != '/' && !IS_SPACE(*p) && *p != '\r') p++;
+        return p;
+    }
+    
+    // Same as parseTriple: i, i/j/k, i//k, i/j
+    static inline vertex_index parseTripleFast(const char **token,
+                                               const char *end, int vsize,
+                                               int vnsize, int vtsize) {
+        vertex_index vi(-1);
+        const char *p = *token;
+        
+        vi.v_idx = fixIndex(parseIntFast(p, end), vsize);
+        p = skipIndexFast(p, end);
+        if (p >= end || p[0] != '/') {
+            (*token) = p;
+            return vi;
+        }
+        p++;
+        
+        // i//k
+        if (p < end && p[0] == '/') {
+            p++;
+            vi.vn_idx = fixIndex(parseIntFast(p, end), vnsize);
+            (*token) = skipIndexFast(p, end);
+            return vi;
+        }
+        
+        // i/j/k or i/j
+        vi.vt_idx = fixIndex(parseIntFast(p, end), vtsize);
+        p = skipIndexFast(p, end);
+        if (p >= end || p[0] != '/') {
+            (*token) = p;
+            return vi;
+        }
+        
+        // i/j/k
+        p++;
+        vi.vn_idx = fixIndex(parseIntFast(p, end), vnsize);
+        (*token) = skipIndexFast(p, end);
+        return vi;
+    }
+    
+    // First whitespace separated word of the range, like sscanf("%s")
+    static inline std::string parseNameFast(const char *token, const char *end) {
+        const char *s = token;
+        while (s < end && (IS_SPACE(*s) || *s == '\r')) s++;
+        return std::string(s, skipTokenFast(s, end));
+    }
+    
+    static inline const char *findLineEnd(const char *p, const char *end) {
+        while (p < end && *p != '\n' && *p != '\r') p++;
+        return p;
+    }
+    
+    static inline const char *nextLine(const char *line_end, const char *end) {
+        if (line_end < end && *line_end == '\r') line_end++;
+        if (line_end < end && *line_end == '\n') line_end++;
+        return line_end;
+    }
+    
+    // One chunk of a buffer parsed by LoadObjFromBuffer. Chunks are parsed
+    // independently (possibly on different threads) and stitched in order.
+    struct obj_chunk {
+        // Non v/vn/vt/f records, replayed in file order while stitching
+        struct event {
+            enum kind_t { USEMTL, MTLLIB, GROUP, OBJECT, TAG } kind;
+            size_t face;  // number of chunk faces before this record
+            std::string name;
+            tag_t tag;
+        };
+        
+        const char *begin;
+        const char *end;
+        
+        std::vector<float> v;
+        std::vector<float> vn;
+        std::vector<float> vt;
+        
+        // Face corners are stored flat; indices are already zero based.
+        // Relative (negative) indices can point into earlier chunks, so they
+        // are stored relative to the chunk start and listed in `rebase`.
+        std::vector<vertex_index> corners;
+        std::vector<unsigned int> sizes;
+        std::vector<size_t> rebase_v, rebase_vn, rebase_vt;
+        
+        std::vector<event> events;
+        
+        // filled while stitching
+        size_t v_base, vn_base, vt_base, corner_base, face_base;
+    };
+    
+    static void parseObjChunk(obj_chunk *chunk) {
+        const char *end = chunk->end;
+        
+        // Counting pass, so the attribute arrays are allocated once
+        size_t numV = 0, numVN = 0, numVT = 0, numF = 0;
+        for (const char *line = chunk->begin; line < end;) {
+            const char *line_end = findLineEnd(line, end);
+            const char *token = skipSpaceFast(line, line_end);
+            if (line_end - token > 2) {
+                if (token[0] == 'v') {
+                    if (IS_SPACE(token[1])) numV++;
+                    else if (token[1] == 'n' && IS_SPACE(token[2])) numVN++;
+                    else if (token[1] == 't' && IS_SPACE(token[2])) numVT++;
+                } else if (token[0] == 'f' && IS_SPACE(token[1])) {
+                    numF++;
+                }
+            }
+            line = nextLine(line_end, end);
+        }
+        
+        chunk->v.reserve(3 * numV);
+        chunk->vn.reserve(3 * numVN);
+        chunk->vt.reserve(2 * numVT);
+        chunk->corners.reserve(3 * numF);
+        chunk->sizes.reserve(numF);
+        
+        for (const char *line = chunk->begin; line < end;) {
+            const char *line_end = findLineEnd(line, end);
+            const char *token = skipSpaceFast(line, line_end);
+            line = nextLine(line_end, end);
+            
+            if (token >= line_end) continue;  // empty line
+            
+            if (token[0] == '#') continue;  // comment line
+            
+            size_t token_len = static_cast<size_t>(line_end - token);
+            
+            // vertex
+            if (token_len > 1 && token[0] == 'v' && IS_SPACE((token[1]))) {
+                token += 2;
+                chunk->v.push_back(parseFloatFast(&token, line_end));
+                chunk->v.push_back(parseFloatFast(&token, line_end));
+                chunk->v.push_back(parseFloatFast(&token, line_end));
+                continue;
+            }
+            
+            // normal
+            if (token_len > 2 && token[0] == 'v' && token[1] == 'n' && IS_SPACE((token[2]))) {
+                token += 3;
+                chunk->vn.push_back(parseFloatFast(&token, line_end));
+                chunk->vn.push_back(parseFloatFast(&token, line_end));
+                chunk->vn.push_back(parseFloatFast(&token, line_end));
+                continue;
+            }
+            
+            // texcoord
+            if (token_len > 2 && token[0] == 'v' && token[1] == 't' && IS_SPACE((token[2]))) {
+                token += 3;
+                chunk->vt.push_back(parseFloatFast(&token, line_end));
+                chunk->vt.push_back(parseFloatFast(&token, line_end));
+                continue;
+            }
+            
+            // face
+            if (token_len > 1 && token[0] == 'f' && IS_SPACE((token[1]))) {
+                token += 2;
+                token = skipSpaceFast(token, line_end);
+                
+                int vsize = static_cast<int>(chunk->v.size() / 3);
+                int vnsize = static_cast<int>(chunk->vn.size() / 3);
+                int vtsize = static_cast<int>(chunk->vt.size() / 2);
+                
+                unsigned int count = 0;
+                while (token < line_end && *token != '\r') {
+                    // relative indices resolve against the chunk's own counts
+                    // here, positive ones are global already
+                    const char *first = token;
+                    vertex_index vi = parseTripleFast(&token, line_end, vsize, vnsize, vtsize);
+                    
+                    size_t corner = chunk->corners.size();
+                    if (*first == '-') chunk->rebase_v.push_back(corner);
+                    const char *slash = static_cast<const char *>(memchr(first, '/', static_cast<size_t>(token - first)));
+                    if (slash) {
+                        // "f 1/" may end the file, never read past the line
+                        if (slash + 1 < line_end && slash[1] == '-') chunk->rebase_vt.push_back(corner);
+                        const char *slash2 = static_cast<const char *>(memchr(slash + 1, '/', static_cast<size_t>(token - slash - 1)));
+                        if (slash2 && slash2 + 1 < line_end && slash2[1] == '-') chunk->rebase_vn.push_back(corner);
+                    }
+                    
+                    chunk->corners.push_back(vi);
+                    count++;
+                    while (token < line_end && (IS_SPACE(*token) || *token == '\r')) token++;
+                }
+                chunk->sizes.push_back(count);
+                
+                continue;
+            }
+            
+            obj_chunk::event e;
+            e.face = chunk->sizes.size();
+            
+            // use mtl
+            if (token_len > 6 && (0 == strncmp(token, "usemtl", 6)) && IS_SPACE((token[6]))) {
+                e.kind = obj_chunk::event::USEMTL;
+                e.name = parseNameFast(token + 7, line_end);
+                chunk->events.push_back(e);
+                continue;
+            }
+            
+            // load mtl
+            if (token_len > 6 && (0 == strncmp(token, "mtllib", 6)) && IS_SPACE((token[6]))) {
+                e.kind = obj_chunk::event::MTLLIB;
+                e.name = parseNameFast(token + 7, line_end);
+                chunk->events.push_back(e);
+                continue;
+            }
+            
+            // group name
+            if (token_len > 1 && token[0] == 'g' && IS_SPACE((token[1]))) {
+                // names[0] is 'g', the group name is the second word
+                const char *s = skipTokenFast(token, line_end);
+                while (s < line_end && (IS_SPACE(*s) || *s == '\r')) s++;
+                e.kind = obj_chunk::event::GROUP;
+                if (s < line_end) e.name = parseNameFast(s, line_end);
+                chunk->events.push_back(e);
+                continue;
+            }
+            
+            // object name
+            if (token_len > 1 && token[0] == 'o' && IS_SPACE((token[1]))) {
+                e.kind = obj_chunk::event::OBJECT;
+                e.name = parseNameFast(token + 2, line_end);
+                chunk->events.push_back(e);
+                continue;
+            }
+            
+            // SubD tags are rare, parse them from a null terminated copy
+            if (token_len > 1 && token[0] == 't' && IS_SPACE(token[1])) {
+                std::string tagLine(token, line_end);
+                e.kind = obj_chunk::event::TAG;
+                e.tag = parseTagLine(tagLine.c_str());
+                chunk->events.push_back(e);
+            }
+            
+            // Ignore unknown command.
+        }
+    }
+    
+    // Copies a chunk's attributes and faces into the global arrays and turns
+    // its chunk-relative indices into global ones.
+    static void mergeObjChunk(const obj_chunk &chunk, attrib_t *attrib,
+                              std::vector<vertex_index> *corners,
+                              std::vector<unsigned int> *sizes) {
+        if (!chunk.v.empty())
+            memcpy(&attrib->vertices[3 * chunk.v_base], &chunk.v[0], chunk.v.size() * sizeof(float));
+        if (!chunk.vn.empty())
+            memcpy(&attrib->normals[3 * chunk.vn_base], &chunk.vn[0], chunk.vn.size() * sizeof(float));
+        if (!chunk.vt.empty())
+            memcpy(&attrib->texcoords[2 * chunk.vt_base], &chunk.vt[0], chunk.vt.size() * sizeof(float));
+        if (!chunk.sizes.empty())
+            memcpy(&(*sizes)[chunk.face_base], &chunk.sizes[0], chunk.sizes.size() * sizeof(unsigned int));
+        if (chunk.corners.empty())
+            return;
+        
+        vertex_index *out = &(*corners)[chunk.corner_base];
+        memcpy(out, &chunk.corners[0], chunk.corners.size() * sizeof(vertex_index));
+        for (size_t i = 0; i < chunk.rebase_v.size(); i++)
+            out[chunk.rebase_v[i]].v_idx += static_cast<int>(chunk.v_base);
+        for (size_t i = 0; i < chunk.rebase_vn.size(); i++)
+            out[chunk.rebase_vn[i]].vn_idx += static_cast<int>(chunk.vn_base);
+        for (size_t i = 0; i < chunk.rebase_vt.size(); i++)
+            out[chunk.rebase_vt[i]].vt_idx += static_cast<int>(chunk.vt_base);
+    }
+    
+    // Same as exportFaceGroupToShape for the faces [first_face, last_face) of
+    // the flat face arrays
+    static bool exportFlatFaceGroupToShape(shape_t *shape,
+                                           const std::vector<vertex_index> &corners,
+                                           const std::vector<unsigned int> &sizes,
+                                           size_t first_face, size_t last_face,
+                                           size_t first_corner,
+                                           const std::vector<tag_t> &tags,
+                                           const int material_id,
+                                           const std::string &name,
+                                           bool triangulate) {
+        if (first_face >= last_face) {
+            return false;
+        }
+        
+        size_t cornerCount = 0;
+        size_t triangleCount = 0;
+        for (size_t i = first_face; i < last_face; i++) {
+            cornerCount += sizes[i];
+            if (sizes[i] > 2) triangleCount += sizes[i] - 2;
+        }
+        if (triangulate) {
+            shape->mesh.indices.reserve(shape->mesh.indices.size() + 3 * triangleCount);
+            shape->mesh.num_face_vertices.reserve(shape->mesh.num_face_vertices.size() + triangleCount);
+            shape->mesh.material_ids.reserve(shape->mesh.material_ids.size() + triangleCount);
+        } else {
+            shape->mesh.indices.reserve(shape->mesh.indices.size() + cornerCount);
+        }
+        
+        const vertex_index *face = corners.empty() ? NULL : &corners[first_corner];
+        for (size_t i = first_face; i < last_face; i++) {
+            size_t npolys = sizes[i];
+            
+            if (triangulate) {
+                vertex_index i0 = npolys > 0 ? face[0] : vertex_index(-1);
+                vertex_index i2 = npolys > 1 ? face[1] : vertex_index(-1);
+                
+                // Polygon -> triangle fan conversion
+                for (size_t k = 2; k < npolys; k++) {
+                    vertex_index i1 = i2;
+                    i2 = face[k];
+                    
+                    index_t idx0, idx1, idx2;
+                    idx0.vertex_index = i0.v_idx;
+                    idx0.normal_index = i0.vn_idx;
+                    idx0.texcoord_index = i0.vt_idx;
+                    idx1.vertex_index = i1.v_idx;
+                    idx1.normal_index = i1.vn_idx;
+                    idx1.texcoord_index = i1.vt_idx;
+                    idx2.vertex_index = i2.v_idx;
+                    idx2.normal_index = i2.vn_idx;
+                    idx2.texcoord_index = i2.vt_idx;
+                    
+                    shape->mesh.indices.push_back(idx0);
+                    shape->mesh.indices.push_back(idx1);
+                    shape->mesh.indices.push_back(idx2);
+                    
+                    shape->mesh.num_face_vertices.push_back(3);
+                    shape->mesh.material_ids.push_back(material_id);
+                }
+            } else {
+                for (size_t k = 0; k < npolys; k++) {
+                    index_t idx;
+                    idx.vertex_index = face[k].v_idx;
+                    idx.normal_index = face[k].vn_idx;
+                    idx.texcoord_index = face[k].vt_idx;
+                    shape->mesh.indices.push_back(idx);
+                }
+                
+                shape->mesh.num_face_vertices.push_back(
+                                                        static_cast<unsigned char>(npolys));
+                shape->mesh.material_ids.push_back(material_id);  // per face
+            }
+            
+            face += npolys;
+        }
+        
+        shape->name = name;
+        shape->mesh.tags = tags;
+        
+        return true;
+    }
+    
+    // Runs job(i) for i in [0, count) on up to `count` threads
+    template <typename Job>
+    static void runOnThreads(size_t count, const Job &job) {
+        if (count <= 1) {
+            if (count == 1) job(0);
+            return;
+        }
+        std::vector<std::thread> workers;
+        workers.reserve(count - 1);
+        for (size_t i = 1; i < count; i++) {
+            workers.push_back(std::thread(job, i));
+        }
+        job(0);
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+    
+    bool LoadObjFromBuffer(attrib_t *attrib, std::vector<shape_t> *shapes,
+                           std::vector<material_t> *materials, std::string *err,
+                           const char *buffer, size_t length,
+                           MaterialReader *readMatFn /*= NULL*/,
+                           bool triangulate, unsigned int num_threads) {
+        attrib->vertices.clear();
+        attrib->normals.clear();
+        attrib->texcoords.clear();
+        shapes->clear();
+        
+        // Split into line aligned chunks; small files are not worth a thread
+        const size_t min_chunk_size = 1024 * 1024;
+        size_t chunkCount = num_threads > 0 ? num_threads : 1;
+        if (chunkCount > length / min_chunk_size) chunkCount = length / min_chunk_size;
+        if (chunkCount == 0) chunkCount = 1;
+        
+        std::vector<obj_chunk> chunks(chunkCount);
+        const char *end = buffer + length;
+        const char *chunk_begin = buffer;
+        for (size_t i = 0; i < chunkCount; i++) {
+            const char *chunk_end = (i + 1 == chunkCount) ? end : buffer + (length / chunkCount) * (i + 1);
+            if (chunk_end < chunk_begin) chunk_end = chunk_begin;
+            while (chunk_end < end && chunk_end[-1] != '\n' && chunk_end[-1] != '\r') chunk_end++;
+            chunks[i].begin = chunk_begin;
+            chunks[i].end = chunk_end;
+            chunk_begin = chunk_end;
+        }
+        
+        runOnThreads(chunkCount, [&chunks](size_t i) { parseObjChunk(&chunks[i]); });
+        
+        // Stitch: global numbering is the running sum of the earlier chunks
+        size_t numV = 0, numVN = 0, numVT = 0, numCorners = 0, numFaces = 0;
+        for (size_t i = 0; i < chunkCount; i++) {
+            chunks[i].v_base = numV;
+            chunks[i].vn_base = numVN;
+            chunks[i].vt_base = numVT;
+            chunks[i].corner_base = numCorners;
+            chunks[i].face_base = numFaces;
+            numV += chunks[i].v.size() / 3;
+            numVN += chunks[i].vn.size() / 3;
+            numVT += chunks[i].vt.size() / 2;
+            numCorners += chunks[i].corners.size();
+            numFaces += chunks[i].sizes.size();
+        }
+        
+        std::vector<vertex_index> corners(numCorners);
+        std::vector<unsigned int> sizes(numFaces);
+        attrib->vertices.resize(3 * numV);
+        attrib->normals.resize(3 * numVN);
+        attrib->texcoords.resize(2 * numVT);
+        
+        runOnThreads(chunkCount, [&](size_t i) {
+            mergeObjChunk(chunks[i], attrib, &corners, &sizes);
+            std::vector<float>().swap(chunks[i].v);
+            std::vector<float>().swap(chunks[i].vn);
+            std::vector<float>().swap(chunks[i].vt);
+            std::vector<vertex_index>().swap(chunks[i].corners);
+        });
+        
+        // Replay the usemtl/mtllib/g/o/t records in file order, exactly like
+        // the sequential loader does, over ranges of the merged face arrays
+        std::vector<size_t> faceCorner(numFaces + 1);
+        faceCorner[0] = 0;
+        for (size_t f = 0; f < numFaces; f++) faceCorner[f + 1] = faceCorner[f] + sizes[f];
+        
+        std::vector<tag_t> tags;
+        std::string name;
+        std::map<std::string, int> material_map;
+        int material = -1;
+        shape_t shape;
+        size_t groupStart = 0;  // first face of the current face group
+        
+        for (size_t c = 0; c < chunkCount; c++) {
+            for (size_t i = 0; i < chunks[c].events.size(); i++) {
+                const obj_chunk::event &e = chunks[c].events[i];
+                size_t face = chunks[c].face_base + e.face;
+                
+                switch (e.kind) {
+                    case obj_chunk::event::USEMTL: {
+                        int newMaterialId = -1;
+                        std::map<std::string, int>::const_iterator it = material_map.find(e.name);
+                        if (it != material_map.end()) {
+                            newMaterialId = it->second;
+                        }
+                        
+                        if (newMaterialId != material) {
+                            exportFlatFaceGroupToShape(&shape, corners, sizes, groupStart, face,
+                                                       faceCorner[groupStart], tags, material, name,
+                                                       triangulate);
+                            groupStart = face;
+                            material = newMaterialId;
+                        }
+                        break;
+                    }
+                    case obj_chunk::event::MTLLIB: {
+                        if (readMatFn) {
+                            std::string err_mtl;
+                            bool ok = (*readMatFn)(e.name, materials, &material_map, &err_mtl);
+                            if (err) {
+                                (*err) += err_mtl;
+                            }
+                            
+                            if (!ok) {
+                                return false;
+                            }
+                        }
+                        break;
+                    }
+                    case obj_chunk::event::GROUP:
+                    case obj_chunk::event::OBJECT: {
+                        // flush previous face group.
+                        bool ret = exportFlatFaceGroupToShape(&shape, corners, sizes, groupStart, face,
+                                                              faceCorner[groupStart], tags, material, name,
+                                                              triangulate);
+                        if (ret) {
+                            shapes->push_back(shape);
+                        }
+                        
+                        shape = shape_t();
+                        groupStart = face;
+                        name = e.name;
+                        break;
+                    }
+                    case obj_chunk::event::TAG:
+                        tags.push_back(e.tag);
+                        break;
+                }
+            }
+        }
+        
+        bool ret = exportFlatFaceGroupToShape(&shape, corners, sizes, groupStart, numFaces,
+                                              faceCorner[groupStart], tags, material, name,
+                                              triangulate);
+        // exportFlatFaceGroupToShape return false when `usemtl` is called in the
+        // last line.
+        // we also add `shape` to `shapes` when `shape.mesh` has already some
+        // faces(indices)
+        if (ret || shape.mesh.indices.size()) {
+            shapes->push_back(shape);
+        }
+        
+        return true;
+    }
 }  // namespace tinyobj
 
 #endif